@@ -6,17 +6,25 @@
  * Copyright(c) 凌 2023.
  */
 
+#include <atomic>
+#include <deque>
+#include <exception>
 #include <memory>
 #include <stdexcept>
 #include <typeinfo>
 #include <vector>
 
+#include "detail/capture.hpp"
 #include "detail/context.hpp"
 #include "detail/function.hpp"
+#include "detail/pool.hpp"
 #include "detail/unsafe_any.hpp"
+#include "optional.hpp"
 #include "promise.hpp"
 
 namespace awacorn {
+class executor;
+class task_group;
 namespace detail {
 /**
  * @brief 生成器的状态。
@@ -26,13 +34,36 @@ enum class async_state_t {
   Active = 1,    // 运行中
   Returned = 2,  // 已返回
   Awaiting = 3,  // await 中
-  Throwed = 4    // 抛出错误
+  Throwed = 4,   // 抛出错误
+  Yielded = 5    // yield 后等待下一次 next
 };
 template <typename Fn>
 struct basic_async_fn;
 template <typename RetType>
 struct async_fn;
+template <typename T>
+struct generator_fn;
 };  // namespace detail
+template <typename T>
+struct generator_context;
+/**
+ * @brief 协程栈池。async 从当前线程的栈池取得栈，协程结束后归还。
+ *
+ * 可以通过 stack_pool::local() 调整当前线程的缓存上限或释放缓存。
+ */
+using stack_pool = detail::stack_pool;
+/**
+ * @brief 在共享栈上运行协程的标记，见 async。
+ */
+struct shared_stack_t {
+  explicit constexpr shared_stack_t() noexcept {}
+};
+constexpr shared_stack_t shared_stack{};
+/**
+ * @brief 协程栈的调用点。统计在此创建的协程的栈峰值，并可以据此自动调整栈
+ * 大小，见 async。
+ */
+using stack_site = detail::stack_site;
 /**
  * @brief 生成器上下文基类。
  */
@@ -49,43 +80,307 @@ struct context {
    */
   template <typename T>
   T operator>>(const promise<T>& value) {
+    using slot_t = variant<T, std::exception_ptr>;
     if (_status != detail::async_state_t::Active)
       throw std::bad_function_call();
-    _status = detail::async_state_t::Awaiting;
-    _result = value.then([](T&& v) { return detail::unsafe_any(std::move(v)); });
-    resume();
-    if (_failbit) {
-      _failbit = false;
-      std::rethrow_exception(detail::unsafe_cast<std::exception_ptr>(_result));
+    if (_cancelled) _throw_cancelled();
+    slot_t slot;
+    // 已完成的 promise 直接取走结果，不注册回调也不切换上下文。
+    if (!detail::promise_access::take(value, slot)) {
+      // 结果直接写入协程栈上的 slot，不经过中间的 promise。
+      _slot = &slot;
+      _ready = false;
+      {
+        // 凭证只能由回调持有，留在协程栈上会使协程永远无法析构。
+        std::shared_ptr<_ticket_t> ticket = _hold();
+        detail::promise_access::subscribe(
+            value,
+            [ticket](T&& v) {
+              context* ctx = ticket->get();
+              // 协程已被取消并从这次 await 中恢复。
+              if (!ctx) return;
+              if (ctx->_displaced()) {
+                ctx->_mail = detail::unsafe_any(std::move(v));
+                ctx->_mailed = true;
+              } else {
+                *static_cast<slot_t*>(ctx->_slot) = std::move(v);
+              }
+              ctx->_wake();
+            },
+            [ticket](std::exception_ptr&& err) {
+              context* ctx = ticket->get();
+              if (!ctx) return;
+              if (ctx->_displaced())
+                ctx->_mail_err = std::move(err);
+              else
+                *static_cast<slot_t*>(ctx->_slot) = std::move(err);
+              ctx->_wake();
+            });
+      }
+      _suspend();
+      if (_mail_err) {
+        slot = _mail_err;
+        _mail_err = nullptr;
+      } else if (_mailed) {
+        slot = detail::unsafe_cast<T>(std::move(_mail));
+        _mail = detail::unsafe_any();
+        _mailed = false;
+      }
     }
-    return detail::unsafe_cast<T>(std::move(_result));
+    if (slot.index() == 1) std::rethrow_exception(get<1>(slot));
+    return std::move(get<0>(slot));
   }
   void operator>>(const promise<void>& value) {
     if (_status != detail::async_state_t::Active)
       throw std::bad_function_call();
-    _status = detail::async_state_t::Awaiting;
-    _result = value.then([]() { return detail::unsafe_any(); });
-    resume();
-    if (_failbit) {
-      _failbit = false;
-      std::rethrow_exception(detail::unsafe_cast<std::exception_ptr>(_result));
+    if (_cancelled) _throw_cancelled();
+    std::exception_ptr slot;
+    if (!detail::promise_access::take(value, slot)) {
+      _slot = &slot;
+      _ready = false;
+      {
+        std::shared_ptr<_ticket_t> ticket = _hold();
+        detail::promise_access::subscribe(
+            value,
+            [ticket]() {
+              if (context* ctx = ticket->get()) ctx->_wake();
+            },
+            [ticket](std::exception_ptr&& err) {
+              context* ctx = ticket->get();
+              if (!ctx) return;
+              if (ctx->_displaced())
+                ctx->_mail_err = std::move(err);
+              else
+                *static_cast<std::exception_ptr*>(ctx->_slot) = std::move(err);
+              ctx->_wake();
+            });
+      }
+      _suspend();
+      if (_mail_err) {
+        slot = _mail_err;
+        _mail_err = nullptr;
+      }
     }
+    if (slot) std::rethrow_exception(slot);
+  }
+  /**
+   * @brief 等待 shared_promise 完成并返回结果的 const 引用，不复制结果。
+   *
+   * @tparam T shared_promise 的结果类型。
+   * @param value shared_promise 本身。
+   * @return const T& 结果，与 shared_promise 的共享状态同生命周期。
+   */
+  template <typename T>
+  auto operator>>(const shared_promise<T>& value) -> decltype(value.value()) {
+    _await_shared(value);
+    return value.value();
   }
 
  private:
-  context(void (*fn)(void*), void* arg, std::size_t stack_size = 0)
+  /**
+   * @brief shared_promise 的回调：只唤醒协程，结果留在共享状态中。
+   */
+  struct _shared_waker {
+    std::shared_ptr<std::shared_ptr<context>> ticket;
+    template <typename... Args>
+    inline void operator()(Args&&...) const {
+      if (context* ctx = ticket->get()) ctx->_wake();
+    }
+  };
+  template <typename T>
+  void _await_shared(const shared_promise<T>& value) {
+    if (_status != detail::async_state_t::Active)
+      throw std::bad_function_call();
+    if (_cancelled) _throw_cancelled();
+    if (value.status() != pending) return;
+    _ready = false;
+    {
+      std::shared_ptr<_ticket_t> ticket = _hold();
+      value.subscribe(_shared_waker{ticket}, _shared_waker{ticket});
+    }
+    _suspend();
+    if (_mail_err) {
+      std::exception_ptr err = std::move(_mail_err);
+      _mail_err = nullptr;
+      std::rethrow_exception(err);
+    }
+  }
+  context(void (*fn)(void*), void (*step)(void*), void* arg,
+          std::size_t stack_size = 0, bool shared = false, bool paint = false)
       : _status(detail::async_state_t::pending),
-        _ctx(fn, arg, stack_size),
-        _failbit(false) {}
+        _ctx(fn, arg, stack_size, shared, paint),
+        _step(step),
+        _arg(arg),
+        _slot(nullptr),
+        _ready(false),
+        _mailed(false),
+        _wake_state(_running),
+        _dispatch(nullptr),
+        _dispatcher(nullptr) {}
   inline void resume() { _ctx.resume(); }
-  detail::unsafe_any _result;
+  /**
+   * @brief 在 await 中切出协程。promise 在注册回调时已同步完成则直接返回。
+   */
+  inline void _suspend() {
+    if (_dispatch) {
+      _status = detail::async_state_t::Awaiting;
+      int state = _notified;
+      if (_wake_state.compare_exchange_strong(state, _running)) {
+        _status = detail::async_state_t::Active;
+        return;
+      }
+      // 由调度方在切出完成后标记 _parked，见 executor::_drive。
+      resume();
+      return;
+    }
+    if (_ready) return;
+    _status = detail::async_state_t::Awaiting;
+    resume();
+  }
+  /**
+   * @brief 协程是否在共享栈上且已切出。此时其栈上的数据可能已被复制走，
+   * 共享栈正被其它协程使用，不能直接写入 _slot。
+   */
+  inline bool _displaced() const noexcept {
+    // 先判断 shared()：由调度器运行的协程不在共享栈上，其 _status
+    // 可能正被其它线程修改。
+    return _ctx.shared() && _status == detail::async_state_t::Awaiting;
+  }
+  /**
+   * @brief await 的 promise 完成后调用。
+   */
+  inline void _wake() {
+    if (_dispatch) {
+      int state = _running;
+      // 协程尚未切出时只做标记，由协程自己或调度方继续运行。
+      if (_wake_state.compare_exchange_strong(state, _notified)) return;
+      _wake_state.store(_running);
+      _dispatch(this);
+      return;
+    }
+    if (_status == detail::async_state_t::Awaiting)
+      _step(_arg);
+    else
+      _ready = true;
+  }
   detail::async_state_t _status;
   detail::basic_context _ctx;
-  bool _failbit;
+  /**
+   * @brief 从 await 中恢复协程，并在协程结束时完成其 promise。
+   */
+  void (*_step)(void*);
+  void* _arg;
+  /**
+   * @brief 协程的所有者。await 期间由回调通过凭证持有，保证协程不被提前
+   * 析构。
+   */
+  std::weak_ptr<void> _owner;
+  /**
+   * @brief 一次 await 注册的回调共同持有的凭证，其中是协程的所有者。
+   * 取消时清空凭证，失效的回调便不再持有协程帧。
+   */
+  using _ticket_t = std::shared_ptr<context>;
+  std::weak_ptr<_ticket_t> _ticket;
+  /**
+   * @brief 为这次 await 创建凭证。凭证从当前线程的 frame_pool 取得。
+   */
+  inline std::shared_ptr<_ticket_t> _hold() {
+    std::shared_ptr<_ticket_t> ticket = std::allocate_shared<_ticket_t>(
+        detail::frame_allocator<char>(), _owner.lock(), this);
+    _ticket = ticket;
+    return ticket;
+  }
+  /**
+   * @brief 当前 await 的结果存放位置，位于协程栈上。
+   */
+  void* _slot;
+  bool _ready;
+  /**
+   * @brief 共享栈模式下，协程切出期间得到的结果。恢复后再移入 _slot。
+   */
+  detail::unsafe_any _mail;
+  std::exception_ptr _mail_err;
+  bool _mailed;
+  /**
+   * @brief 由调度器运行时 (见 executor::async)，await 的 promise 可能在其它
+   * 线程完成。_wake_state 协调唤醒与切出的先后：
+   * - _running：协程正在运行或即将恢复；
+   * - _notified：切出完成前 promise 已完成；
+   * - _parked：协程已切出，由唤醒方交给 _dispatch 重新调度。
+   */
+  enum : int { _running = 0, _notified = 1, _parked = 2 };
+  std::atomic<int> _wake_state;
+  /**
+   * @brief 不为 nullptr 时，唤醒的协程交由 _dispatch 调度而不是直接恢复。
+   */
+  void (*_dispatch)(context*);
+  void* _dispatcher;
+  /**
+   * @brief 协程运行中被取消时，在下一次 await 时抛出的异常。
+   */
+  std::exception_ptr _cancelled;
+  /**
+   * @brief 取消协程，见 task_group。正在 await 时立即以 err 恢复，否则在下一次
+   * await 时抛出 err。只能在运行协程的线程上调用，调用方须持有协程的
+   * 所有者。
+   */
+  inline void _cancel(const std::exception_ptr& err) {
+    if (_status != detail::async_state_t::Awaiting) {
+      _cancelled = err;
+      return;
+    }
+    // 使这次 await 注册的回调失效，并不再持有协程帧。
+    if (std::shared_ptr<_ticket_t> ticket = _ticket.lock()) ticket->reset();
+    _mail_err = err;
+    _mailed = false;
+    _wake();
+  }
+  [[noreturn]] inline void _throw_cancelled() {
+    std::exception_ptr err = _cancelled;
+    _cancelled = nullptr;
+    std::rethrow_exception(err);
+  }
   template <typename T>
   friend struct detail::async_fn;
   template <typename T>
   friend struct detail::basic_async_fn;
+  template <typename T>
+  friend struct detail::generator_fn;
+  template <typename T>
+  friend struct generator_context;
+  friend class executor;
+  friend class task_group;
+};
+/**
+ * @brief 生成器上下文。除了 await 之外，还可以通过 yield 向调用方逐个交出值。
+ *
+ * @tparam T 交出的值的类型。
+ */
+template <typename T>
+struct generator_context : context {
+  /**
+   * @brief 交出一个值并切出协程，直到调用方再次调用
+   * async_generator::next。
+   *
+   * @param value 交出的值。
+   */
+  void yield(T value) {
+    if (_status != detail::async_state_t::Active)
+      throw std::bad_function_call();
+    _value.emplace(std::move(value));
+    _status = detail::async_state_t::Yielded;
+    resume();
+  }
+
+ private:
+  generator_context(void (*fn)(void*), void (*step)(void*), void* arg,
+                    std::size_t stack_size)
+      : context(fn, step, arg, stack_size) {}
+  /**
+   * @brief yield 交出、尚未交给调用方的值。
+   */
+  optional<T> _value;
+  friend struct detail::generator_fn<T>;
 };
 namespace detail {
 template <typename Fn>
@@ -93,144 +388,236 @@ struct basic_async_fn {
  protected:
   context ctx;
   function<Fn> fn;
+  /**
+   * @brief 协程结束时向其报告栈用量的调用点，可以为 nullptr。
+   */
+  stack_site* site;
   template <typename U>
-  basic_async_fn(U&& fn, void (*run_fn)(void*), void* args,
-                 std::size_t stack_size = 0)
-      : ctx(run_fn, args, stack_size), fn(std::forward<U>(fn)) {}
+  basic_async_fn(U&& fn, void (*run_fn)(void*), void (*step_fn)(void*),
+                 void* args, std::size_t stack_size = 0, bool shared = false,
+                 stack_site* site = nullptr)
+      : ctx(run_fn, step_fn, args, site ? site->size() : stack_size, shared,
+            site && site->sample()),
+        fn(std::allocator_arg, frame_allocator<char>(), std::forward<U>(fn)),
+        site(site) {}
+  /**
+   * @brief 在协程结束前 (仍在协程栈上时) 调用。只有被调用点抽样的协程
+   * 填充了栈，其余协程的 stack_usage 为 0，不报告。
+   */
+  inline void report_stack() noexcept {
+    if (!site) return;
+    if (std::size_t usage = ctx._ctx.stack_usage()) site->record(usage);
+  }
   basic_async_fn(const basic_async_fn&) = delete;
   basic_async_fn& operator=(const basic_async_fn&) = delete;
+  friend class awacorn::executor;
+  friend class awacorn::task_group;
 };
 template <typename RetType>
-struct async_fn : basic_async_fn<RetType(context&)>,
-                  std::enable_shared_from_this<async_fn<RetType>> {
+struct async_fn : basic_async_fn<RetType(context&)> {
   explicit async_fn(const async_fn&) = delete;
+  /**
+   * @brief 开始运行协程。
+   *
+   * @return promise<RetType> 协程的结果。
+   */
   promise<RetType> next() {
-    if (this->ctx._status == async_state_t::pending) {
-      this->ctx._status = async_state_t::Active;
-      this->ctx.resume();
-      if (this->ctx._status == async_state_t::Awaiting) {
-        auto ref = this->shared_from_this();
-        promise<RetType> pm;
-        auto tmp = std::move(detail::unsafe_cast<promise<detail::unsafe_any>>(
-            std::move(this->ctx._result)));
-        tmp.then([ref, pm](detail::unsafe_any&& res) {
-             ref->ctx._result = std::move(res);
-             ref->_await_next()
-                 .then([pm](RetType&& res) { pm.resolve(std::move(res)); })
-                 .error(
-                     [pm](std::exception_ptr&& err) { pm.reject(std::move(err)); });
-           })
-            .error([ref, pm](std::exception_ptr&& err) {
-              ref->ctx._result = std::move(err);
-              ref->ctx._failbit = true;
-              ref->_await_next()
-                  .then([pm](RetType&& res) { pm.resolve(std::move(res)); })
-                  .error(
-                      [pm](std::exception_ptr&& err) { pm.reject(std::move(err)); });
-            });
-        return pm;
-      } else if (this->ctx._status == async_state_t::Returned) {
-        return resolve(std::move(
-            detail::unsafe_cast<RetType>(std::move(this->ctx._result))));
-      }
-      return reject<RetType>(std::move(detail::unsafe_cast<std::exception_ptr>(
-          std::move(this->ctx._result))));
-    } else if (this->ctx._status == async_state_t::Returned) {
-      return resolve(std::move(
-          detail::unsafe_cast<RetType>(std::move(this->ctx._result))));
-    }
-    return reject<RetType>(std::move(
-        detail::unsafe_cast<std::exception_ptr>(std::move(this->ctx._result))));
+    if (this->ctx._status == async_state_t::pending) step_fn(this);
+    return _pm;
   }
+  /**
+   * @brief 创建协程。协程帧与引用计数位于同一次分配中，和函数对象、结果
+   * promise 的状态一样从当前线程的 frame_pool 取得。
+   */
   template <typename... Args>
   static inline std::shared_ptr<async_fn> create(Args&&... args) {
-    return std::shared_ptr<async_fn>(new async_fn(std::forward<Args>(args)...));
+    std::shared_ptr<async_fn> ret = std::allocate_shared<async_fn>(
+        frame_allocator<async_fn>(), _key(), std::forward<Args>(args)...);
+    ret->ctx._owner = ret;
+    return ret;
   }
 
  private:
-  inline promise<RetType> _await_next() {
-    this->ctx._status = async_state_t::pending;
-    return this->next();
-  }
+  struct _key {};
+
+ public:
   template <typename U>
-  explicit async_fn(U&& fn, std::size_t stack_size = 0)
+  async_fn(_key, U&& fn, std::size_t stack_size = 0, bool shared = false)
       : basic_async_fn<RetType(context&)>(
-            std::forward<U>(fn), (void (*)(void*))run_fn, this, stack_size) {}
+            std::forward<U>(fn), (void (*)(void*))run_fn,
+            (void (*)(void*))step_fn, this, stack_size, shared),
+        _pm(std::allocator_arg, frame_allocator<char>()) {}
+  template <typename U>
+  async_fn(_key, U&& fn, stack_site& site)
+      : basic_async_fn<RetType(context&)>(
+            std::forward<U>(fn), (void (*)(void*))run_fn,
+            (void (*)(void*))step_fn, this, 0, false, &site),
+        _pm(std::allocator_arg, frame_allocator<char>()) {}
+
+ private:
+  promise<RetType> _pm;
+  variant<RetType, std::exception_ptr> _ret;
+  friend class awacorn::executor;
+  friend class awacorn::task_group;
   static void run_fn(async_fn* self) {
     try {
-      self->ctx._result = self->fn(self->ctx);
+      self->_ret = self->fn(self->ctx);
       self->ctx._status = async_state_t::Returned;
     } catch (...) {
-      self->ctx._result = std::current_exception();
+      basic_context::rethrow_unwind();
+      self->_ret = std::current_exception();
       self->ctx._status = async_state_t::Throwed;
     }
+    self->report_stack();
+  }
+  static void step_fn(async_fn* self) {
+    self->ctx._status = async_state_t::Active;
     self->ctx.resume();
+    if (self->ctx._status == async_state_t::Returned)
+      self->_pm.resolve(std::move(get<0>(self->_ret)));
+    else if (self->ctx._status == async_state_t::Throwed)
+      self->_pm.reject(std::move(get<1>(self->_ret)));
   }
 };
 template <>
-struct async_fn<void> : basic_async_fn<void(context&)>,
-                        std::enable_shared_from_this<async_fn<void>> {
+struct async_fn<void> : basic_async_fn<void(context&)> {
   explicit async_fn(const async_fn&) = delete;
   async_fn& operator=(const async_fn&) = delete;
+  /**
+   * @brief 开始运行协程。
+   *
+   * @return promise<void> 协程的结果。
+   */
   promise<void> next() {
-    if (this->ctx._status == async_state_t::pending) {
-      this->ctx._status = async_state_t::Active;
-      this->ctx.resume();
-      if (this->ctx._status == async_state_t::Awaiting) {
-        auto ref = this->shared_from_this();
-        promise<void> pm;
-        auto tmp = std::move(detail::unsafe_cast<promise<detail::unsafe_any>>(
-            std::move(this->ctx._result)));
-        tmp.then([ref, pm](detail::unsafe_any&& res) {
-             ref->ctx._result = std::move(res);
-             ref->_await_next()
-                 .then([pm]() { pm.resolve(); })
-                 .error(
-                     [pm](std::exception_ptr&& err) { pm.reject(std::move(err)); });
-           })
-            .error([ref, pm](std::exception_ptr&& err) {
-              ref->ctx._result = std::move(err);
-              ref->ctx._failbit = true;
-              ref->_await_next()
-                  .then([pm]() { pm.resolve(); })
-                  .error(
-                      [pm](std::exception_ptr&& err) { pm.reject(std::move(err)); });
-            });
-        return pm;
-      } else if (this->ctx._status == async_state_t::Returned) {
-        return resolve();
-      }
-      return reject<void>(std::move(detail::unsafe_cast<std::exception_ptr>(
-          std::move(this->ctx._result))));
-    } else if (this->ctx._status == async_state_t::Returned) {
-      return resolve();
-    }
-    return reject<void>(std::move(
-        detail::unsafe_cast<std::exception_ptr>(std::move(this->ctx._result))));
+    if (this->ctx._status == async_state_t::pending) step_fn(this);
+    return _pm;
   }
+  /**
+   * @brief 创建协程。协程帧与引用计数位于同一次分配中，和函数对象、结果
+   * promise 的状态一样从当前线程的 frame_pool 取得。
+   */
   template <typename... Args>
   static inline std::shared_ptr<async_fn> create(Args&&... args) {
-    return std::shared_ptr<async_fn>(new async_fn(std::forward<Args>(args)...));
+    std::shared_ptr<async_fn> ret = std::allocate_shared<async_fn>(
+        frame_allocator<async_fn>(), _key(), std::forward<Args>(args)...);
+    ret->ctx._owner = ret;
+    return ret;
   }
 
  private:
-  inline promise<void> _await_next() {
-    this->ctx._status = async_state_t::pending;
-    return this->next();
-  }
+  struct _key {};
+
+ public:
+  template <typename U>
+  async_fn(_key, U&& fn, std::size_t stack_size = 0, bool shared = false)
+      : basic_async_fn<void(context&)>(std::forward<U>(fn),
+                                       (void (*)(void*))run_fn,
+                                       (void (*)(void*))step_fn, this,
+                                       stack_size, shared),
+        _pm(std::allocator_arg, frame_allocator<char>()) {}
   template <typename U>
-  explicit async_fn(U&& fn, std::size_t stack_size = 0)
-      : basic_async_fn<void(context&)>(
-            std::forward<U>(fn), (void (*)(void*))run_fn, this, stack_size) {}
+  async_fn(_key, U&& fn, stack_site& site)
+      : basic_async_fn<void(context&)>(std::forward<U>(fn),
+                                       (void (*)(void*))run_fn,
+                                       (void (*)(void*))step_fn, this, 0,
+                                       false, &site),
+        _pm(std::allocator_arg, frame_allocator<char>()) {}
+
+ private:
+  promise<void> _pm;
+  std::exception_ptr _err;
+  friend class awacorn::executor;
+  friend class awacorn::task_group;
   static void run_fn(async_fn* self) {
     try {
       self->fn(self->ctx);
       self->ctx._status = async_state_t::Returned;
     } catch (...) {
-      self->ctx._result = std::current_exception();
+      basic_context::rethrow_unwind();
+      self->_err = std::current_exception();
+      self->ctx._status = async_state_t::Throwed;
+    }
+    self->report_stack();
+  }
+  static void step_fn(async_fn* self) {
+    self->ctx._status = async_state_t::Active;
+    self->ctx.resume();
+    if (self->ctx._status == async_state_t::Returned)
+      self->_pm.resolve();
+    else if (self->ctx._status == async_state_t::Throwed)
+      self->_pm.reject(std::move(self->_err));
+  }
+};
+template <typename T>
+struct generator_fn {
+  generator_context<T> ctx;
+  function<void(generator_context<T>&)> fn;
+  /**
+   * @brief 当前 next 返回的 promise。
+   */
+  promise<optional<T>> req;
+  bool requested;
+  std::exception_ptr err;
+  template <typename U>
+  generator_fn(U&& fn, std::size_t stack_size)
+      : ctx((void (*)(void*))run_fn, (void (*)(void*))step_fn, this,
+            stack_size),
+        fn(std::allocator_arg, frame_allocator<char>(), std::forward<U>(fn)),
+        req(std::allocator_arg, frame_allocator<char>()),
+        requested(false) {}
+  generator_fn(const generator_fn&) = delete;
+  generator_fn& operator=(const generator_fn&) = delete;
+  template <typename U>
+  static inline std::shared_ptr<generator_fn> create(U&& fn,
+                                                     std::size_t stack_size) {
+    std::shared_ptr<generator_fn> ret = std::allocate_shared<generator_fn>(
+        frame_allocator<generator_fn>(), std::forward<U>(fn), stack_size);
+    ret->ctx._owner = ret;
+    return ret;
+  }
+  promise<optional<T>> next() {
+    if (requested || ctx._status == async_state_t::Active)
+      throw std::logic_error("The generator is already running.");
+    req = promise<optional<T>>(std::allocator_arg, frame_allocator<char>());
+    promise<optional<T>> ret = req;
+    if (done()) {
+      ret.resolve(optional<T>());
+    } else {
+      requested = true;
+      step_fn(this);
+    }
+    return ret;
+  }
+  inline bool done() const noexcept {
+    return ctx._status == async_state_t::Returned ||
+           ctx._status == async_state_t::Throwed;
+  }
+  static void run_fn(generator_fn* self) {
+    try {
+      self->fn(self->ctx);
+      self->ctx._status = async_state_t::Returned;
+    } catch (...) {
+      basic_context::rethrow_unwind();
+      self->err = std::current_exception();
       self->ctx._status = async_state_t::Throwed;
     }
+  }
+  static void step_fn(generator_fn* self) {
+    self->ctx._status = async_state_t::Active;
     self->ctx.resume();
+    if (self->ctx._status == async_state_t::Awaiting) return;
+    // 回调中可能再次调用 next，先取出本次的 promise。
+    promise<optional<T>> pm = self->req;
+    self->requested = false;
+    if (self->ctx._status == async_state_t::Yielded) {
+      optional<T> value = std::move(self->ctx._value);
+      self->ctx._value.reset();
+      pm.resolve(std::move(value));
+    } else if (self->ctx._status == async_state_t::Returned) {
+      pm.resolve(optional<T>());
+    } else {
+      pm.reject(std::move(self->err));
+    }
   }
 };
 };  // namespace detail
@@ -250,6 +637,262 @@ auto async(U&& fn, std::size_t stack_size = 0)
              std::forward<U>(fn), stack_size)
       ->next();
 }
+/**
+ * @brief 在当前线程的共享栈上进入异步函数上下文。
+ *
+ * 协程切出后，只有它实际用到的部分栈会被复制到按需分配的保存区，适合大量
+ * 空闲的协程。协程只能在创建它的线程上恢复，切换时需要复制栈上的数据。
+ * 仅在 AWACORN_USE_ASM 下有效，其它实现仍使用独立的栈。
+ *
+ * @tparam U 函数类型。
+ * @param fn 函数。
+ * @return promise<decltype(fn(std::declval<context&>()))> 用于取得函数返回值的
+ * promise 对象。
+ */
+template <typename U>
+auto async(U&& fn, shared_stack_t)
+    -> promise<decltype(fn(std::declval<context&>()))> {
+  return detail::async_fn<decltype(fn(std::declval<context&>()))>::create(
+             std::forward<U>(fn), std::size_t(0), true)
+      ->next();
+}
+/**
+ * @brief 以调用点 site 决定的栈大小进入异步函数上下文，并在协程结束时向
+ * site 报告栈的峰值用量。
+ *
+ * @tparam U 函数类型。
+ * @param fn 函数。
+ * @param site 调用点，必须比协程存活更久 (通常为静态变量)。
+ * @return promise<decltype(fn(std::declval<context&>()))> 用于取得函数返回值的
+ * promise 对象。
+ */
+template <typename U>
+auto async(U&& fn, stack_site& site)
+    -> promise<decltype(fn(std::declval<context&>()))> {
+  return detail::async_fn<decltype(fn(std::declval<context&>()))>::create(
+             std::forward<U>(fn), site)
+      ->next();
+}
+/**
+ * @brief 有栈生成器。函数体通过 generator_context::yield 逐个交出值，调用方
+ * 通过 next 逐个取得，同一时刻最多只有一个值在传递中。
+ *
+ * 函数体在第一次调用 next 时才开始运行，每次 next 运行到下一次 yield、
+ * 返回或抛出异常为止，期间同样可以 await。
+ *
+ * @tparam T 交出的值的类型。
+ */
+template <typename T>
+class async_generator {
+  std::shared_ptr<detail::generator_fn<T>> _fn;
+
+ public:
+  /**
+   * @brief 创建生成器。生成器帧从当前线程的 frame_pool 取得。
+   *
+   * @param fn 函数，接受 generator_context<T>&。
+   * @param stack_size 可选，栈的大小(字节, 如果可用)。
+   */
+  template <typename U,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<U>::type, async_generator>::value>::type>
+  explicit async_generator(U&& fn, std::size_t stack_size = 0)
+      : _fn(detail::generator_fn<T>::create(std::forward<U>(fn), stack_size)) {
+  }
+  /**
+   * @brief 运行生成器直到下一次 yield。
+   *
+   * @return promise<optional<T>> yield 交出的值。生成器返回后为空，抛出异常
+   * 时失败。
+   * @exception std::logic_error 上一次 next 尚未完成，或在生成器内部调用时
+   * 抛出。
+   */
+  inline promise<optional<T>> next() { return _fn->next(); }
+  /**
+   * @brief 生成器是否已经返回或抛出异常。
+   */
+  inline bool done() const noexcept { return _fn->done(); }
+};
+/**
+ * @brief task_group 取消子协程时，在其 await 处抛出的异常。
+ */
+struct task_cancelled : std::exception {
+  const char* what() const noexcept override { return "task cancelled"; }
+};
+/**
+ * @brief 结构化并发的任务组。动态地创建子协程，限制同时运行的数量，并在
+ * 第一个子协程失败时取消其余的子协程。
+ *
+ * 任务组只持有尚未开始的子协程的函数对象，子协程结束后其帧立即释放，因此
+ * 峰值内存只与同时运行的子协程数量有关。任务组只能在一个线程上使用。
+ */
+class task_group {
+  struct child {
+    std::weak_ptr<void> owner;
+    context* ctx;
+  };
+  struct state {
+    /**
+     * @brief 同时运行的子协程数量上限，0 表示不限制。
+     */
+    std::size_t limit;
+    std::size_t running;
+    /**
+     * @brief 因达到上限而等待开始的子协程。
+     */
+    std::deque<detail::function<void(const std::shared_ptr<state>&)>> queue;
+    std::vector<child> children;
+    /**
+     * @brief 第一个失败的子协程的异常，或取消时的 task_cancelled。
+     */
+    std::exception_ptr error;
+    promise<void> waiter;
+    bool waiting;
+    explicit state(std::size_t limit)
+        : limit(limit), running(0), waiting(false) {}
+  };
+  /**
+   * @brief 子协程成功结束时调用，忽略其结果。
+   */
+  struct _on_return {
+    std::shared_ptr<state> st;
+    context* ctx;
+    template <typename... Args>
+    void operator()(Args&&...) const {
+      _done(st, ctx, nullptr);
+    }
+  };
+  std::shared_ptr<state> _state;
+
+  template <typename Ret, typename U>
+  static void _start(const std::shared_ptr<state>& st, U&& fn,
+                     std::size_t stack_size) {
+    std::shared_ptr<detail::async_fn<Ret>> co =
+        detail::async_fn<Ret>::create(std::forward<U>(fn), stack_size);
+    context* ctx = &co->ctx;
+    st->running++;
+    st->children.push_back(child{co, ctx});
+    // 只持有子协程的弱引用，子协程结束后帧即被释放。
+    detail::promise_access::subscribe(
+        co->_pm, _on_return{st, ctx},
+        [st, ctx](std::exception_ptr&& err) { _done(st, ctx, err); });
+    co->next();
+  }
+  static void _done(const std::shared_ptr<state>& st, context* ctx,
+                    const std::exception_ptr& err) {
+    for (std::size_t i = 0; i < st->children.size(); i++) {
+      if (st->children[i].ctx == ctx && !st->children[i].owner.expired()) {
+        st->children[i] = std::move(st->children.back());
+        st->children.pop_back();
+        break;
+      }
+    }
+    st->running--;
+    if (err && !st->error) _fail(st, err);
+    while (!st->error && !st->queue.empty() &&
+           (!st->limit || st->running < st->limit)) {
+      detail::function<void(const std::shared_ptr<state>&)> start =
+          std::move(st->queue.front());
+      st->queue.pop_front();
+      start(st);
+    }
+    _settle(st);
+  }
+  static void _fail(const std::shared_ptr<state>& st,
+                    const std::exception_ptr& err) {
+    st->error = err;
+    st->queue.clear();
+    // 被取消的子协程会立即恢复，期间可能修改 children。
+    std::vector<child> children;
+    children.swap(st->children);
+    std::exception_ptr cancelled = std::make_exception_ptr(task_cancelled());
+    for (auto&& c : children) {
+      std::shared_ptr<void> owner = c.owner.lock();
+      if (owner) c.ctx->_cancel(cancelled);
+    }
+  }
+  static void _settle(const std::shared_ptr<state>& st) {
+    if (!st->waiting || st->running || !st->queue.empty()) return;
+    st->waiting = false;
+    promise<void> pm = st->waiter;
+    if (st->error)
+      pm.reject(st->error);
+    else
+      pm.resolve();
+  }
+
+ public:
+  /**
+   * @brief 构造任务组。
+   *
+   * @param limit 同时运行的子协程数量上限，0 表示不限制。
+   */
+  explicit task_group(std::size_t limit = 0)
+      : _state(std::make_shared<state>(limit)) {}
+  task_group(const task_group&) = delete;
+  task_group& operator=(const task_group&) = delete;
+  /**
+   * @brief 析构时取消仍在运行或等待开始的子协程。
+   */
+  ~task_group() {
+    if (_state->running || !_state->queue.empty()) cancel();
+  }
+  /**
+   * @brief 创建子协程。未达到上限时立即开始运行 (直到第一次 await)，否则
+   * 等待其它子协程结束。任务组已失败或被取消时忽略。
+   *
+   * @param fn 函数，返回值被忽略。
+   * @param stack_size 可选，栈的大小(字节, 如果可用)。
+   */
+  template <typename U>
+  void spawn(U&& fn, std::size_t stack_size = 0) {
+    using Ret = decltype(fn(std::declval<context&>()));
+    state& st = *_state;
+    if (st.error) return;
+    if (!st.limit || st.running < st.limit) {
+      _start<Ret>(_state, std::forward<U>(fn), stack_size);
+      return;
+    }
+    auto arg_fn = detail::capture(std::forward<U>(fn));
+    st.queue.push_back(
+        [arg_fn, stack_size](const std::shared_ptr<state>& st) mutable {
+          _start<Ret>(st, std::move(arg_fn.borrow()), stack_size);
+        });
+  }
+  /**
+   * @brief 等待所有子协程结束。
+   *
+   * @return promise<void> 所有子协程结束后完成；任一子协程失败时，在其余
+   * 子协程被取消并结束后以第一个异常失败。
+   * @exception std::logic_error 上一次 wait 尚未完成时抛出。
+   */
+  promise<void> wait() {
+    state& st = *_state;
+    if (st.waiting)
+      throw std::logic_error("The task group is already being waited.");
+    st.waiter = promise<void>();
+    st.waiting = true;
+    promise<void> ret = st.waiter;
+    _settle(_state);
+    return ret;
+  }
+  /**
+   * @brief 取消所有子协程：丢弃等待开始的子协程，并在正在运行的子协程的
+   * 下一次 await 处抛出 task_cancelled。此后 wait 以 task_cancelled 失败。
+   */
+  void cancel() {
+    if (!_state->error)
+      _fail(_state, std::make_exception_ptr(task_cancelled()));
+  }
+  /**
+   * @brief 正在运行的子协程数量。
+   */
+  inline std::size_t running() const noexcept { return _state->running; }
+  /**
+   * @brief 等待开始的子协程数量。
+   */
+  inline std::size_t queued() const noexcept { return _state->queue.size(); }
+};
 };  // namespace awacorn
 #endif
 #endif
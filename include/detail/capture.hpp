@@ -5,6 +5,8 @@
  * Project Awacorn 基于 MIT 协议开源。
  * Copyright(c) 凌 2022.
  */
+#include <type_traits>
+#include <utility>
 namespace awacorn {
 namespace detail {
 /**
@@ -27,11 +29,15 @@ struct capture_helper {
   /**
    * @brief 使用左值引用进行移动构造。
    */
-  constexpr capture_helper(capture_helper& rhs) : val(std::move(rhs.val)) {}
+  constexpr capture_helper(capture_helper& rhs) noexcept(
+      std::is_nothrow_move_constructible<T>::value)
+      : val(std::move(rhs.val)) {}
   /**
    * @brief 使用右值引用进行移动构造。
    */
-  constexpr capture_helper(capture_helper&& rhs) : val(std::move(rhs.val)) {}
+  constexpr capture_helper(capture_helper&& rhs) noexcept(
+      std::is_nothrow_move_constructible<T>::value)
+      : val(std::move(rhs.val)) {}
   capture_helper& operator=(const capture_helper& rhs) = delete;
   /**
    * @brief 借用对象的左值引用 (可用于移动构造)。
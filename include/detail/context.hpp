@@ -5,7 +5,8 @@
  * Project Awacorn 基于 MIT 协议开源。
  * Copyright(c) 凌 2022.
  */
-#if !defined(AWACORN_USE_BOOST) && !defined(AWACORN_USE_UCONTEXT)
+#if !defined(AWACORN_USE_BOOST) && !defined(AWACORN_USE_UCONTEXT) && \
+    !defined(AWACORN_USE_ASM)
 #if __has_include(<boost/context/continuation.hpp>)
 #define AWACORN_USE_BOOST
 #elif __has_include(<ucontext.h>)
@@ -21,54 +22,508 @@
 #define _XOPEN_SOURCE
 #endif
 #include <ucontext.h>
+
+#include <memory>
+#elif defined(AWACORN_USE_ASM)
+#if !defined(__ELF__) || !(defined(__x86_64__) || defined(__aarch64__))
+#error "AWACORN_USE_ASM" only supports x86-64 and AArch64 ELF targets.
+#endif
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#endif
+#include "stack.hpp"
+#if defined(AWACORN_USE_ASM)
+// awacorn_asm_switch(from, to): 将被调用方保存的寄存器压入当前栈，把栈顶写入
+// *from，再切换到 to 保存的栈顶并恢复寄存器。
+// awacorn_asm_start: 新协程的入口，以保存的 arg 调用保存的 fn，fn 不会返回。
+// 切换后以间接跳转而不是 ret 返回：返回地址属于另一个栈，用 ret 会使 CPU 的
+// 返回地址预测每次都失败。
+// 以 COMDAT 形式输出，包含此头文件的多个翻译单元链接时只保留一份。
+#if defined(__x86_64__)
+asm(R"(
+  .pushsection .text.awacorn_asm_context,"axG",%progbits,awacorn_asm_context,comdat
+  .weak awacorn_asm_switch
+  .hidden awacorn_asm_switch
+  .type awacorn_asm_switch, %function
+  .p2align 4
+awacorn_asm_switch:
+  pushq %rbp
+  pushq %rbx
+  pushq %r12
+  pushq %r13
+  pushq %r14
+  pushq %r15
+  subq $8, %rsp
+  stmxcsr (%rsp)
+  fnstcw 4(%rsp)
+  movq %rsp, (%rdi)
+  movq %rsi, %rsp
+  ldmxcsr (%rsp)
+  fldcw 4(%rsp)
+  addq $8, %rsp
+  popq %r15
+  popq %r14
+  popq %r13
+  popq %r12
+  popq %rbx
+  popq %rbp
+  popq %r8
+  jmpq *%r8
+  .size awacorn_asm_switch, .-awacorn_asm_switch
+  .weak awacorn_asm_start
+  .hidden awacorn_asm_start
+  .type awacorn_asm_start, %function
+  .p2align 4
+awacorn_asm_start:
+  .cfi_startproc
+  .cfi_undefined %rip
+  movq %r12, %rdi
+  callq *%r13
+  ud2
+  .cfi_endproc
+  .size awacorn_asm_start, .-awacorn_asm_start
+  .popsection
+)");
+#elif defined(__aarch64__)
+asm(R"(
+  .pushsection .text.awacorn_asm_context,"axG",%progbits,awacorn_asm_context,comdat
+  .weak awacorn_asm_switch
+  .hidden awacorn_asm_switch
+  .type awacorn_asm_switch, %function
+  .p2align 4
+awacorn_asm_switch:
+  sub sp, sp, #160
+  stp d8, d9, [sp, #0]
+  stp d10, d11, [sp, #16]
+  stp d12, d13, [sp, #32]
+  stp d14, d15, [sp, #48]
+  stp x19, x20, [sp, #64]
+  stp x21, x22, [sp, #80]
+  stp x23, x24, [sp, #96]
+  stp x25, x26, [sp, #112]
+  stp x27, x28, [sp, #128]
+  stp x29, x30, [sp, #144]
+  mov x9, sp
+  str x9, [x0]
+  mov sp, x1
+  ldp d8, d9, [sp, #0]
+  ldp d10, d11, [sp, #16]
+  ldp d12, d13, [sp, #32]
+  ldp d14, d15, [sp, #48]
+  ldp x19, x20, [sp, #64]
+  ldp x21, x22, [sp, #80]
+  ldp x23, x24, [sp, #96]
+  ldp x25, x26, [sp, #112]
+  ldp x27, x28, [sp, #128]
+  ldp x29, x30, [sp, #144]
+  add sp, sp, #160
+  br x30
+  .size awacorn_asm_switch, .-awacorn_asm_switch
+  .weak awacorn_asm_start
+  .hidden awacorn_asm_start
+  .type awacorn_asm_start, %function
+  .p2align 4
+awacorn_asm_start:
+  .cfi_startproc
+  .cfi_undefined x30
+  mov x0, x19
+  blr x20
+  brk #0
+  .cfi_endproc
+  .size awacorn_asm_start, .-awacorn_asm_start
+  .popsection
+)");
+#endif
+extern "C" {
+void awacorn_asm_switch(void** from, void* to);
+void awacorn_asm_start();
+}
 #endif
 namespace awacorn {
 namespace detail {
 
 #if defined(AWACORN_USE_BOOST)
 struct basic_context {
-  basic_context(void (*fn)(void*), void* arg, std::size_t stack_size = 0)
-      : _ctx(boost::context::callcc(
+  /**
+   * @brief 从 stack_pool 取得栈的 Boost.Context 栈分配器。
+   */
+  struct pooled_stack {
+    std::size_t size;
+    basic_context* self;
+    boost::context::stack_context allocate() {
+      char* low = static_cast<char*>(stack_pool::acquire(size));
+      if (self->_painted) stack_site::paint(low, size);
+      self->_low = low;
+      self->_size = size;
+      boost::context::stack_context sctx;
+      sctx.size = size;
+      sctx.sp = low + size;
+      return sctx;
+    }
+    void deallocate(boost::context::stack_context& sctx) noexcept {
+      stack_pool::release(static_cast<char*>(sctx.sp) - sctx.size, sctx.size,
+                          self->_painted);
+    }
+  };
+  /**
+   * @brief 不支持共享栈，shared 为 true 时仍使用独立的栈。paint 为 true 时
+   * 填充栈，以便通过 stack_usage 取得栈用量。
+   */
+  basic_context(void (*fn)(void*), void* arg, std::size_t stack_size = 0,
+                bool /* shared */ = false, bool paint = false)
+      : _low(nullptr),
+        _size(0),
+        _painted(paint),
+        _ctx(boost::context::callcc(
             std::allocator_arg,
-            boost::context::fixedsize_stack(
-                stack_size ? stack_size
-                           : boost::context::stack_traits::default_size()),
+            pooled_stack{stack_pool::round(
+                             stack_size
+                                 ? stack_size
+                                 : boost::context::stack_traits::default_size()),
+                         this},
             [this, fn, arg](boost::context::continuation&& ctx) {
               _ctx = ctx.resume();
               fn(arg);
               return std::move(_ctx);
             })) {}
   inline void resume() { _ctx = _ctx.resume(); }
+  inline bool shared() const noexcept { return false; }
+  /**
+   * @brief 栈的峰值用量 (字节)。构造时未指定 paint 则返回 0。只能在协程结束
+   * 前调用。
+   */
+  inline std::size_t stack_usage() const noexcept {
+    return _painted ? stack_site::measure(_low, _size) : 0;
+  }
+  /**
+   * @brief 在 catch (...) 中调用。当前异常是析构未完成的协程时用于展开栈的
+   * forced_unwind 时将其重新抛出。
+   */
+  static inline void rethrow_unwind() {
+    try {
+      throw;
+    } catch (const boost::context::detail::forced_unwind&) {
+      throw;
+    } catch (...) {
+    }
+  }
 
  private:
+  char* _low;
+  std::size_t _size;
+  bool _painted;
   boost::context::continuation _ctx;
 };
 #elif defined(AWACORN_USE_UCONTEXT)
 struct basic_context {
-  basic_context(void (*fn)(void*), void* arg, std::size_t stack_size = 0)
-      : _stack(nullptr, [](char* ptr) {
-          if (ptr) delete[] ptr;
-        }) {
+  /**
+   * @brief 不支持共享栈，shared 为 true 时仍使用独立的栈。paint 为 true 时
+   * 填充栈，以便通过 stack_usage 取得栈用量。
+   */
+  basic_context(void (*fn)(void*), void* arg, std::size_t stack_size = 0,
+                bool /* shared */ = false, bool paint = false)
+      : _stack(nullptr, _stack_deleter{0, false}), _painted(paint) {
     getcontext(&_ctx);
     if (!stack_size) stack_size = 128 * 1024;  // default stack size
-    _stack.reset(new char[stack_size]);
+    stack_size = stack_pool::round(stack_size);
+    _stack = std::unique_ptr<char, _stack_deleter>(
+        static_cast<char*>(stack_pool::acquire(stack_size)),
+        _stack_deleter{stack_size, paint});
+    if (paint) stack_site::paint(_stack.get(), stack_size);
     _ctx.uc_stack.ss_sp = _stack.get();
     _ctx.uc_stack.ss_size = stack_size;
     _ctx.uc_stack.ss_flags = 0;
-    _ctx.uc_link = nullptr;
+    // fn 返回时切换到最近一次 resume 保存在 _ctx 中的调用方。
+    _ctx.uc_link = &_ctx;
     makecontext(&_ctx, (void (*)(void))fn, 1, arg);
   }
   inline void resume() {
     ucontext_t orig = _ctx;
     swapcontext(&_ctx, &orig);
   }
+  inline bool shared() const noexcept { return false; }
+  /**
+   * @brief 栈的峰值用量 (字节)。构造时未指定 paint 则返回 0。
+   */
+  inline std::size_t stack_usage() const noexcept {
+    return _painted ? stack_site::measure(_stack.get(),
+                                          _stack.get_deleter().size)
+                    : 0;
+  }
+  static inline void rethrow_unwind() noexcept {}
 
  private:
+  struct _stack_deleter {
+    std::size_t size;
+    bool painted;
+    inline void operator()(char* ptr) const noexcept {
+      if (ptr) stack_pool::release(ptr, size, painted);
+    }
+  };
   ucontext_t _ctx;
-  std::unique_ptr<char, void (*)(char*)> _stack;
+  std::unique_ptr<char, _stack_deleter> _stack;
+  bool _painted;
+};
+#elif defined(AWACORN_USE_ASM)
+struct basic_context {
+  /**
+   * @param fn 协程的入口。
+   * @param arg fn 的参数。
+   * @param stack_size 独立栈的大小，为 0 时使用默认大小。
+   * @param shared 是否在当前线程的共享栈 (见 stack_pool::shared) 上运行。
+   * @param paint 是否填充独立的栈，以便通过 stack_usage 取得栈用量。
+   */
+  basic_context(void (*fn)(void*), void* arg, std::size_t stack_size = 0,
+                bool shared = false, bool paint = false)
+      : _fn(fn),
+        _arg(arg),
+        _size(0),
+        _stack(nullptr),
+        _shared(nullptr),
+        _caller(nullptr),
+        _slice(nullptr),
+        _slice_size(0),
+        _slice_cap(0),
+        _slice_sp(nullptr),
+        _running(false),
+        _started(false),
+        _done(false),
+        _unwinding(false),
+        _painted(false) {
+    stack_pool* pool = shared ? stack_pool::local() : nullptr;
+    if (pool) {
+      // 初始的寄存器作为已保存的部分，第一次切入时再复制到共享栈上。
+      _shared = &pool->shared();
+      char frame[_frame_size];
+      _make_frame(frame + _frame_size, &_entry, this);
+      _reserve(_frame_size);
+      std::memcpy(_slice, frame, _frame_size);
+      _slice_size = _frame_size;
+      _slice_sp = _top() - _frame_size;
+      _sp = _slice_sp;
+    } else {
+      _size = stack_pool::round(stack_size ? stack_size : 128 * 1024);
+      _stack = static_cast<char*>(stack_pool::acquire(_size));
+      if ((_painted = paint)) stack_site::paint(_stack, _size);
+      _sp = _make_frame(_top(), &_entry, this);
+    }
+  }
+  basic_context(const basic_context&) = delete;
+  basic_context& operator=(const basic_context&) = delete;
+  ~basic_context() {
+    // 析构尚未结束的协程时，在协程内抛出 forced_unwind 以展开其栈。
+    if (_started && !_done) {
+      _unwinding = true;
+      resume();
+    }
+    if (_shared) {
+      if (_shared->occupant == this) _shared->occupant = nullptr;
+      std::free(_slice);
+    } else {
+      stack_pool::release(_stack, _size, _painted);
+    }
+  }
+  /**
+   * @brief 切换到协程 (在协程外调用) 或切换回最近一次 resume 的调用方
+   * (在协程内调用)。
+   */
+  inline void resume() {
+    basic_context*& current = _current();
+    if (!_running) {
+      _running = true;
+      _caller = current;
+      current = _shared ? this : nullptr;
+      _switch(&_sp, _sp, _caller, current);
+    } else {
+      _running = false;
+      current = _caller;
+      _switch(&_sp, _sp, _shared ? this : nullptr, _caller);
+    }
+    if (_unwinding && !_done) throw forced_unwind();
+  }
+  /**
+   * @brief 是否在共享栈上运行。
+   */
+  inline bool shared() const noexcept { return _shared; }
+  /**
+   * @brief 栈的峰值用量 (字节)。构造时未指定 paint 或在共享栈上运行时返回 0。
+   */
+  inline std::size_t stack_usage() const noexcept {
+    return _painted ? stack_site::measure(_stack, _size) : 0;
+  }
+  /**
+   * @brief 在 catch (...) 中调用。当前异常是析构未完成的协程时用于展开栈的
+   * forced_unwind 时将其重新抛出。
+   */
+  static inline void rethrow_unwind() {
+    try {
+      throw;
+    } catch (const forced_unwind&) {
+      throw;
+    } catch (...) {
+    }
+  }
+
+ private:
+  struct forced_unwind {};
+#if defined(__x86_64__)
+  static constexpr std::size_t _frame_size = 8 * sizeof(void*);
+#elif defined(__aarch64__)
+  static constexpr std::size_t _frame_size = 20 * sizeof(void*);
+#endif
+  /**
+   * @brief 在 top 之下构造第一次切入时由 awacorn_asm_switch 恢复的寄存器，
+   * 使其 "返回" 到 awacorn_asm_start，再由后者调用 fn(arg)。
+   *
+   * @param top 栈顶，按 16 字节对齐。
+   * @return void* 切换时使用的栈顶。
+   */
+  static void* _make_frame(char* top, void (*fn)(void*), void* arg) noexcept {
+    void** sp = reinterpret_cast<void**>(top - _frame_size);
+    for (std::size_t i = 0; i < _frame_size / sizeof(void*); i++)
+      sp[i] = nullptr;
+#if defined(__x86_64__)
+    // MXCSR 与 x87 控制字的默认值。
+    sp[0] = reinterpret_cast<void*>((std::uintptr_t(0x037F) << 32) | 0x1F80);
+    sp[3] = reinterpret_cast<void*>(fn);  // r13
+    sp[4] = arg;                          // r12
+    sp[7] = reinterpret_cast<void*>(&awacorn_asm_start);
+#elif defined(__aarch64__)
+    sp[8] = arg;                                            // x19
+    sp[9] = reinterpret_cast<void*>(fn);                    // x20
+    sp[19] = reinterpret_cast<void*>(&awacorn_asm_start);  // x30
+#endif
+    return sp;
+  }
+  inline char* _top() const noexcept {
+    return _shared ? _shared->base + _shared->size : _stack + _size;
+  }
+  static void _entry(void* arg) {
+    basic_context* self = static_cast<basic_context*>(arg);
+    self->_started = true;
+    try {
+      self->_fn(self->_arg);
+    } catch (const forced_unwind&) {
+    }
+    self->_done = true;
+    self->_running = false;
+    _current() = self->_caller;
+    // 已结束的协程不需要保存栈上的数据。
+    if (self->_shared) self->_shared->occupant = nullptr;
+    // 最后一次切换回调用方，之后不会再恢复此协程。
+    _switch(&self->_sp, self->_sp, nullptr, self->_caller);
+  }
+  /**
+   * @brief 当前线程上正在共享栈上运行的协程。
+   */
+  static inline basic_context*& _current() noexcept {
+    static thread_local basic_context* current = nullptr;
+    return current;
+  }
+  /**
+   * @brief 共享栈的切换在独立的小栈上进行：复制栈上的数据时不能运行在
+   * 被覆盖的栈上。
+   */
+  struct _relocator {
+    void* sp;
+    char* stack;
+    // 正在进行的切换。
+    void** slot;
+    basic_context* from;
+    void* to_sp;
+    basic_context* to;
+    _relocator() : stack(static_cast<char*>(stack_pool::acquire(_stack_size))) {
+      sp = _make_frame(stack + _stack_size, &_run, this);
+    }
+    ~_relocator() { stack_pool::release(stack, _stack_size); }
+    static constexpr std::size_t _stack_size = 64 * 1024;
+    static void _run(void* arg) {
+      _relocator* self = static_cast<_relocator*>(arg);
+      for (;;) {
+        if (basic_context* from = self->from)
+          from->_slice_sp = static_cast<char*>(*self->slot);
+        basic_context* to = self->to;
+        if (to && to->_shared->occupant != to) {
+          if (void* occupant = to->_shared->occupant)
+            static_cast<basic_context*>(occupant)->_save();
+          to->_restore();
+          to->_shared->occupant = to;
+        }
+        awacorn_asm_switch(&self->sp, self->to_sp);
+      }
+    }
+  };
+  /**
+   * @brief 保存当前执行状态到 *slot 并切换到 to_sp。from 和 to 分别是切出
+   * 和切入的共享栈协程 (不在共享栈上时为 nullptr)。
+   */
+  static inline void _switch(void** slot, void* to_sp, basic_context* from,
+                             basic_context* to) {
+    if (!from && !to) return awacorn_asm_switch(slot, to_sp);
+    static thread_local _relocator relocator;
+    relocator.slot = slot;
+    relocator.from = from;
+    relocator.to_sp = to_sp;
+    relocator.to = to;
+    awacorn_asm_switch(slot, relocator.sp);
+  }
+  /**
+   * @brief 调整保存区的大小。保存区总是与实际用到的栈大小相近。
+   */
+  inline void _reserve(std::size_t size) noexcept {
+    if (_slice_cap >= size && _slice_cap / 2 <= size) return;
+    void* slice = std::realloc(_slice, size);
+    // 切换过程中无法报告错误。
+    if (!slice) std::abort();
+    _slice = static_cast<char*>(slice);
+    _slice_cap = size;
+  }
+  /**
+   * @brief 将共享栈上属于此协程的部分复制到保存区。
+   */
+  inline void _save() noexcept {
+    _slice_size = std::size_t(_top() - _slice_sp);
+    _reserve(_slice_size);
+    std::memcpy(_slice, _slice_sp, _slice_size);
+  }
+  /**
+   * @brief 将保存区复制回共享栈。
+   */
+  inline void _restore() noexcept {
+    std::memcpy(_top() - _slice_size, _slice, _slice_size);
+  }
+  void (*_fn)(void*);
+  void* _arg;
+  std::size_t _size;
+  char* _stack;
+  stack_pool::shared_stack* _shared;
+  /**
+   * @brief 最近一次 resume 时的调用方，调用方不在共享栈上时为 nullptr。
+   */
+  basic_context* _caller;
+  /**
+   * @brief 共享栈模式下，切出时栈上数据的保存区。
+   */
+  char* _slice;
+  std::size_t _slice_size;
+  std::size_t _slice_cap;
+  /**
+   * @brief 共享栈模式下，最近一次切出时的栈顶。
+   */
+  char* _slice_sp;
+  /**
+   * @brief 另一方 (协程或其调用方) 切出时保存的栈顶。
+   */
+  void* _sp;
+  bool _running;
+  bool _started;
+  bool _done;
+  bool _unwinding;
+  bool _painted;
 };
 #else
-#error Please define "AWACORN_USE_UCONTEXT" or "AWACORN_USE_BOOST".
+#error Please define "AWACORN_USE_UCONTEXT", "AWACORN_USE_BOOST" or "AWACORN_USE_ASM".
 #endif
 
 }  // namespace detail
@@ -5,67 +5,209 @@
  * Project Awacorn 基于 MIT 协议开源。
  * Copyright(c) 凌 2022.
  */
+#include <cstddef>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 namespace awacorn {
 namespace detail {
 template <typename>
 class function;
 template <typename Ret, typename... Args>
 class function<Ret(Args...)> {
-  struct _m_base {
-    virtual Ret operator()(Args...) = 0;
-    virtual ~_m_base() = default;
+  /**
+   * @brief 内联存储的大小。不超过此大小、且移动构造不抛出异常的可调用对象
+   * 直接存放在函数对象内部，其余的存放在堆上。
+   */
+  static constexpr std::size_t _m_size = 3 * sizeof(void*);
+  /**
+   * @brief 手写的虚表，避免虚函数调用和额外的间接层。
+   */
+  struct _m_vtable {
+    Ret (*call)(void*, Args&&...);
+    /**
+     * @brief 将 src 中的对象移动到 dst，并析构 src 中的对象。为 nullptr
+     * 时直接复制内联存储。
+     */
+    void (*move)(void* dst, void* src) noexcept;
+    /**
+     * @brief 析构对象。为 nullptr 时无需析构。
+     */
+    void (*destroy)(void*) noexcept;
   };
   template <typename T>
-  struct _m_derived : _m_base {
-    using value_type = typename std::decay<T>::type;
-    value_type fn;
+  struct _m_fits
+      : std::integral_constant<
+            bool, sizeof(T) <= _m_size && alignof(void*) % alignof(T) == 0 &&
+                      std::is_nothrow_move_constructible<T>::value> {};
+  // 存放在内联存储中的可调用对象。
+  template <typename T>
+  struct _m_inline {
+    static Ret call(void* p, Args&&... args) {
+      return (*static_cast<T*>(p))(std::forward<Args>(args)...);
+    }
+    static void move(void* dst, void* src) noexcept {
+      ::new (dst) T(std::move(*static_cast<T*>(src)));
+      static_cast<T*>(src)->~T();
+    }
+    static void destroy(void* p) noexcept { static_cast<T*>(p)->~T(); }
+    static inline const _m_vtable* vtable() noexcept {
+      // 平凡的对象 (如只捕获指针的 lambda) 按字节复制，不需要析构。
+      static const _m_vtable vt = {
+          call, std::is_trivially_copyable<T>::value ? nullptr : move,
+          std::is_trivially_destructible<T>::value ? nullptr : destroy};
+      return &vt;
+    }
+  };
+  // 存放在堆上的可调用对象，内联存储中只保存指针。
+  template <typename T>
+  struct _m_heap {
+    static Ret call(void* p, Args&&... args) {
+      return (**static_cast<T**>(p))(std::forward<Args>(args)...);
+    }
+    static void destroy(void* p) noexcept { delete *static_cast<T**>(p); }
+    static inline const _m_vtable* vtable() noexcept {
+      static const _m_vtable vt = {call, nullptr, destroy};
+      return &vt;
+    }
+  };
+  // 由分配器申请内存的可调用对象。
+  template <typename T, typename Alloc>
+  struct _m_allocated {
+    using allocator_type = typename std::allocator_traits<
+        Alloc>::template rebind_alloc<_m_allocated>;
+    allocator_type alloc;
+    T fn;
 
-    _m_derived(const value_type& fn) : fn(fn) {}
-    _m_derived(value_type&& fn) : fn(std::move(fn)) {}
-    Ret operator()(Args... args) override {
-      return fn(std::forward<Args>(args)...);
+    template <typename U>
+    _m_allocated(const allocator_type& alloc, U&& fn)
+        : alloc(alloc), fn(std::forward<U>(fn)) {}
+    static Ret call(void* p, Args&&... args) {
+      return (*static_cast<_m_allocated**>(p))
+          ->fn(std::forward<Args>(args)...);
+    }
+    static void destroy(void* p) noexcept {
+      _m_allocated* node = *static_cast<_m_allocated**>(p);
+      allocator_type tmp(node->alloc);
+      node->~_m_allocated();
+      std::allocator_traits<allocator_type>::deallocate(tmp, node, 1);
+    }
+    static inline const _m_vtable* vtable() noexcept {
+      static const _m_vtable vt = {call, nullptr, destroy};
+      return &vt;
     }
   };
-  std::unique_ptr<_m_base> ptr;
+  alignas(void*) mutable unsigned char _m_buf[_m_size];
+  const _m_vtable* _m_vt;
+
+  template <typename U>
+  static inline void _m_check() noexcept {
+    static_assert(
+        std::is_same<decltype(std::declval<U>()(std::declval<Args>()...)),
+                     Ret>::value,
+        "T is not the same as Ret(Args...)");
+  }
+  inline void _m_reset() noexcept {
+    if (_m_vt) {
+      if (_m_vt->destroy) _m_vt->destroy(_m_buf);
+      _m_vt = nullptr;
+    }
+  }
+  inline void _m_take(function& fn) noexcept {
+    if ((_m_vt = fn._m_vt)) {
+      if (_m_vt->move)
+        _m_vt->move(_m_buf, fn._m_buf);
+      else
+        std::memcpy(_m_buf, fn._m_buf, _m_size);
+      fn._m_vt = nullptr;
+    }
+  }
 
  public:
-  function() = default;
-  function(std::nullptr_t) {}
+  function() noexcept : _m_vt(nullptr) {}
+  function(std::nullptr_t) noexcept : _m_vt(nullptr) {}
   /**
    * @brief 由可调用对象构造函数对象。
    *
    * @tparam U 可调用对象的类型
    * @param fn 可调用对象的实例。
    */
-  template <typename U>
-  function(U&& fn)
-      : ptr(std::unique_ptr<_m_base>(new _m_derived<U>(std::forward<U>(fn)))) {
-    static_assert(
-        std::is_same<decltype(std::declval<U>()(std::declval<Args>()...)),
-                     Ret>::value,
-        "T is not the same as Ret(Args...)");
+  template <typename U, typename T = typename std::decay<U>::type,
+            typename std::enable_if<_m_fits<T>::value, int>::type = 0>
+  function(U&& fn) : _m_vt(_m_inline<T>::vtable()) {
+    _m_check<U>();
+    ::new (static_cast<void*>(_m_buf)) T(std::forward<U>(fn));
+  }
+  template <typename U, typename T = typename std::decay<U>::type,
+            typename std::enable_if<!_m_fits<T>::value, long>::type = 0>
+  function(U&& fn) : _m_vt(_m_heap<T>::vtable()) {
+    _m_check<U>();
+    ::new (static_cast<void*>(_m_buf)) T*(new T(std::forward<U>(fn)));
+  }
+  /**
+   * @brief 由可调用对象构造函数对象。可调用对象无法内联存储时，通过 alloc
+   * 申请存储空间。
+   *
+   * @tparam Alloc 分配器类型。
+   * @tparam U 可调用对象的类型
+   * @param alloc 分配器。
+   * @param fn 可调用对象的实例。
+   */
+  template <typename Alloc, typename U,
+            typename T = typename std::decay<U>::type,
+            typename std::enable_if<_m_fits<T>::value, int>::type = 0>
+  function(std::allocator_arg_t, const Alloc&, U&& fn)
+      : function(std::forward<U>(fn)) {}
+  template <typename Alloc, typename U,
+            typename T = typename std::decay<U>::type,
+            typename std::enable_if<!_m_fits<T>::value, long>::type = 0>
+  function(std::allocator_arg_t, const Alloc& alloc, U&& fn)
+      : _m_vt(nullptr) {
+    _m_check<U>();
+    using node_t = _m_allocated<T, Alloc>;
+    using traits = std::allocator_traits<typename node_t::allocator_type>;
+    typename node_t::allocator_type a(alloc);
+    node_t* node = traits::allocate(a, 1);
+    try {
+      ::new (static_cast<void*>(node)) node_t(a, std::forward<U>(fn));
+    } catch (...) {
+      traits::deallocate(a, node, 1);
+      throw;
+    }
+    ::new (static_cast<void*>(_m_buf)) node_t*(node);
+    _m_vt = node_t::vtable();
   }
   function(const function&) = delete;
   function& operator=(const function&) = delete;
-  function(function&& fn) : ptr(std::move(fn.ptr)) {}
-  function& operator=(function&& fn) {
-    return (ptr = std::move(fn.ptr)), *this;
+  function(function&& fn) noexcept { _m_take(fn); }
+  function& operator=(function&& fn) noexcept {
+    if (this != &fn) {
+      _m_reset();
+      _m_take(fn);
+    }
+    return *this;
   }
+  ~function() { _m_reset(); }
   /**
    * @brief 将此函数对象跟 fn 交换。
    *
    * @param fn 目标函数对象。
    */
-  inline void swap(function& fn) noexcept { std::swap(ptr, fn.ptr); }
+  inline void swap(function& fn) noexcept {
+    function tmp(std::move(fn));
+    fn = std::move(*this);
+    *this = std::move(tmp);
+  }
   /**
    * @brief 判断函数是否已被初始化。
    *
    * @return true 函数已被初始化
    * @return false 函数未被初始化
    */
-  inline operator bool() const noexcept { return !!ptr; }
+  inline operator bool() const noexcept { return !!_m_vt; }
   /**
    * @brief 调用函数。
    *
@@ -73,7 +215,7 @@ class function<Ret(Args...)> {
    * @return Ret 函数的返回值。
    */
   inline Ret operator()(Args&&... args) const {
-    if (*this) return (*ptr)(std::forward<Args>(args)...);
+    if (*this) return _m_vt->call(_m_buf, std::forward<Args>(args)...);
     throw std::bad_function_call();
   }
 };
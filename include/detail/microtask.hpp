@@ -0,0 +1,78 @@
+#ifndef _AWACORN_MICROTASK_
+#define _AWACORN_MICROTASK_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#include <deque>
+#include <utility>
+
+#include "function.hpp"
+namespace awacorn {
+namespace detail {
+/**
+ * @brief promise 回调的 microtask 队列。
+ *
+ * 当前线程安装了队列时，promise 的回调不会在 resolve / reject
+ * (或在已完成的 promise 上注册回调) 时立刻调用，而是加入队列，
+ * 由队列的所有者在当前回调返回后依次执行。这样长的 then
+ * 链和紧凑的 await 循环不会让调用栈无限增长。
+ */
+class microtask_queue {
+  std::deque<function<void()>> _tasks;
+
+ public:
+  microtask_queue() = default;
+  microtask_queue(const microtask_queue&) = delete;
+  microtask_queue& operator=(const microtask_queue&) = delete;
+  /**
+   * @brief 当前线程安装的队列。没有安装时为 nullptr。
+   */
+  static inline microtask_queue*& current() noexcept {
+    static thread_local microtask_queue* queue = nullptr;
+    return queue;
+  }
+  /**
+   * @brief 在作用域内将队列安装到当前线程。
+   */
+  class scope {
+    microtask_queue* _prev;
+
+   public:
+    explicit scope(microtask_queue* queue) noexcept : _prev(current()) {
+      current() = queue;
+    }
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+    ~scope() { current() = _prev; }
+  };
+  inline void push(function<void()>&& fn) { _tasks.push_back(std::move(fn)); }
+  inline bool empty() const noexcept { return _tasks.empty(); }
+  /**
+   * @brief 依次执行队列中的任务，包括执行过程中加入的任务。
+   */
+  void run() {
+    while (!_tasks.empty()) {
+      function<void()> fn = std::move(_tasks.front());
+      _tasks.pop_front();
+      fn();
+    }
+  }
+};
+/**
+ * @brief 当前线程安装了 microtask 队列时将 fn 加入队列，否则立刻调用。
+ *
+ * @param fn 要调用的函数。
+ */
+template <typename U>
+inline void defer(U&& fn) {
+  if (microtask_queue* queue = microtask_queue::current())
+    queue->push(function<void()>(std::forward<U>(fn)));
+  else
+    fn();
+}
+};  // namespace detail
+};  // namespace awacorn
+#endif
+#endif
@@ -0,0 +1,74 @@
+#ifndef _AWACORN_MPSC_
+#define _AWACORN_MPSC_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#include <atomic>
+#include <utility>
+namespace awacorn {
+namespace detail {
+/**
+ * @brief 无锁的多生产者单消费者队列。
+ *
+ * push 可以在任意线程调用 (一次原子交换)，pop 和 empty 只能由唯一的消费者调用。
+ * 生产者在交换之后、链接之前被打断时，该元素暂时对消费者不可见。
+ */
+template <typename T>
+class mpsc_queue {
+  struct node {
+    std::atomic<node*> next;
+    T value;
+    node() : next(nullptr) {}
+    explicit node(T&& value) : next(nullptr), value(std::move(value)) {}
+  };
+  // 生产者一侧：最后入队的节点。
+  std::atomic<node*> _head;
+  // 消费者一侧：哨兵节点，其后继为队首。
+  node* _tail;
+
+ public:
+  mpsc_queue() : _head(new node()), _tail(_head.load()) {}
+  mpsc_queue(const mpsc_queue&) = delete;
+  mpsc_queue& operator=(const mpsc_queue&) = delete;
+  ~mpsc_queue() {
+    while (node* next = _tail->next.load()) {
+      delete _tail;
+      _tail = next;
+    }
+    delete _tail;
+  }
+  /**
+   * @brief 入队。线程安全。
+   *
+   * @param value 元素。
+   */
+  void push(T&& value) {
+    node* n = new node(std::move(value));
+    _head.exchange(n)->next.store(n);
+  }
+  /**
+   * @brief 出队。只能由消费者调用。
+   *
+   * @param value 用于接收元素。
+   * @return true 取出了一个元素。
+   * @return false 队列为空。
+   */
+  bool pop(T& value) {
+    node* next = _tail->next.load();
+    if (!next) return false;
+    value = std::move(next->value);
+    delete _tail;
+    _tail = next;
+    return true;
+  }
+  /**
+   * @brief 队列是否为空。只能由消费者调用。
+   */
+  inline bool empty() const noexcept { return !_tail->next.load(); }
+};
+};  // namespace detail
+};  // namespace awacorn
+#endif
+#endif
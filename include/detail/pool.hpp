@@ -0,0 +1,317 @@
+#ifndef _AWACORN_POOL_
+#define _AWACORN_POOL_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+namespace awacorn {
+namespace detail {
+/**
+ * @brief 按大小分级的空闲链表分配器，不是线程安全的。
+ *
+ * 不超过 _classes * _align 字节的请求从对应级别的空闲链表取出，
+ * 链表为空时一次申请一整块 (slab)。释放的内存回到空闲链表，直到 pool
+ * 析构时才归还给系统，因此稳定状态下的申请、释放不会调用 malloc。
+ * 更大的请求直接使用 operator new。
+ */
+class pool {
+  struct block {
+    block* next;
+  };
+  static constexpr std::size_t _align = alignof(std::max_align_t);
+  static constexpr std::size_t _classes = 8;
+  // 每个 slab 的块数。
+  static constexpr std::size_t _chunk = 64;
+  std::array<block*, _classes> _free;
+  std::vector<void*> _slabs;
+
+  static inline std::size_t _class_of(std::size_t size) noexcept {
+    return size ? (size - 1) / _align : 0;
+  }
+  /**
+   * @brief 不经过空闲链表，直接申请满足 align 的内存。
+   */
+  static inline void* _new(std::size_t size, std::size_t align) {
+#if defined(__cpp_aligned_new)
+    if (align > _align) return ::operator new(size, std::align_val_t(align));
+#else
+    (void)align;
+#endif
+    return ::operator new(size);
+  }
+  static inline void _delete(void* ptr, std::size_t align) noexcept {
+#if defined(__cpp_aligned_new)
+    if (align > _align) return ::operator delete(ptr, std::align_val_t(align));
+#else
+    (void)align;
+#endif
+    ::operator delete(ptr);
+  }
+  void _grow(std::size_t c) {
+    const std::size_t size = (c + 1) * _align;
+    char* slab = static_cast<char*>(::operator new(size * _chunk));
+    try {
+      _slabs.push_back(slab);
+    } catch (...) {
+      ::operator delete(slab);
+      throw;
+    }
+    for (std::size_t i = _chunk; i > 0; i--) {
+      block* b = reinterpret_cast<block*>(slab + (i - 1) * size);
+      b->next = _free[c];
+      _free[c] = b;
+    }
+  }
+
+ public:
+  pool() : _free() {}
+  pool(const pool&) = delete;
+  pool& operator=(const pool&) = delete;
+  ~pool() {
+    for (auto&& slab : _slabs) ::operator delete(slab);
+  }
+  /**
+   * @brief 申请内存。
+   *
+   * @param size 字节数。
+   * @param align 对齐要求，超过 alignof(std::max_align_t) 时不使用空闲链表，
+   * 而是以对齐的 operator new 申请。
+   * @return void* 内存。
+   */
+  void* allocate(std::size_t size, std::size_t align = _align) {
+    const std::size_t c = _class_of(size);
+    if (c >= _classes || align > _align) return _new(size, align);
+    if (!_free[c]) _grow(c);
+    block* b = _free[c];
+    _free[c] = b->next;
+    return b;
+  }
+  /**
+   * @brief 释放内存。
+   *
+   * @param ptr 由 allocate 申请的内存。
+   * @param size 申请时的字节数。
+   * @param align 申请时的对齐要求。
+   */
+  void deallocate(void* ptr, std::size_t size,
+                  std::size_t align = _align) noexcept {
+    const std::size_t c = _class_of(size);
+    if (c >= _classes || align > _align) return _delete(ptr, align);
+    block* b = static_cast<block*>(ptr);
+    b->next = _free[c];
+    _free[c] = b;
+  }
+};
+/**
+ * @brief 从 pool 申请内存的分配器。
+ *
+ * @tparam T 元素类型。
+ */
+template <typename T>
+struct pool_allocator {
+  using value_type = T;
+  pool* source;
+  explicit pool_allocator(pool* source) noexcept : source(source) {}
+  template <typename U>
+  pool_allocator(const pool_allocator<U>& rhs) noexcept
+      : source(rhs.source) {}
+  inline T* allocate(std::size_t n) {
+    return static_cast<T*>(source->allocate(n * sizeof(T), alignof(T)));
+  }
+  inline void deallocate(T* ptr, std::size_t n) noexcept {
+    source->deallocate(ptr, n * sizeof(T), alignof(T));
+  }
+  template <typename U>
+  inline bool operator==(const pool_allocator<U>& rhs) const noexcept {
+    return source == rhs.source;
+  }
+  template <typename U>
+  inline bool operator!=(const pool_allocator<U>& rhs) const noexcept {
+    return source != rhs.source;
+  }
+};
+/**
+ * @brief 按大小分级缓存小块内存的线程局部池，用于 async 的协程帧、promise
+ * 的状态与回调记录等短期对象。
+ *
+ * 与 pool 不同，每个块都单独申请，因此可以在任意线程释放：块回到释放时所在
+ * 线程的池中 (超过上限时直接释放)。协程在执行器的线程之间迁移时仍然安全。
+ */
+class frame_pool {
+  struct block {
+    block* next;
+  };
+  static constexpr std::size_t _align = alignof(std::max_align_t);
+  static constexpr std::size_t _classes = 128;
+  std::array<block*, _classes> _free;
+  std::array<std::size_t, _classes> _count;
+  std::size_t _limit;
+
+  static inline std::size_t _class_of(std::size_t size) noexcept {
+    return size ? (size - 1) / _align : 0;
+  }
+  static inline bool& _destroyed() noexcept {
+    static thread_local bool destroyed = false;
+    return destroyed;
+  }
+  static inline frame_pool*& _installed() noexcept {
+    static thread_local frame_pool* installed = nullptr;
+    return installed;
+  }
+  struct _holder;
+
+ public:
+  /**
+   * @brief 构造池。
+   *
+   * @param limit 每个级别最多缓存的块数。
+   */
+  explicit frame_pool(std::size_t limit = 256) noexcept
+      : _free(), _count(), _limit(limit) {}
+  frame_pool(const frame_pool&) = delete;
+  frame_pool& operator=(const frame_pool&) = delete;
+  ~frame_pool() { trim(); }
+  /**
+   * @brief 当前线程的池：通过 scope 安装的池，没有安装时为线程局部的池。
+   * 线程退出、池析构之后返回 nullptr。
+   */
+  static inline frame_pool* local() noexcept;
+  /**
+   * @brief 在作用域内将池安装到当前线程，代替线程局部的池。用于让
+   * event_loop 拥有其回调中产生的短期对象的缓存。
+   */
+  class scope {
+    frame_pool* _prev;
+
+   public:
+    explicit scope(frame_pool* pool) noexcept : _prev(_installed()) {
+      _installed() = pool;
+    }
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+    ~scope() { _installed() = _prev; }
+  };
+  /**
+   * @brief 申请内存。超过 _classes * _align 字节的请求直接使用 operator new。
+   *
+   * @param size 字节数。
+   * @return void* 内存，按 alignof(std::max_align_t) 对齐。
+   */
+  void* allocate(std::size_t size) {
+    const std::size_t c = _class_of(size);
+    if (c >= _classes) return ::operator new(size);
+    if (block* b = _free[c]) {
+      _free[c] = b->next;
+      _count[c]--;
+      return b;
+    }
+    return ::operator new((c + 1) * _align);
+  }
+  /**
+   * @brief 释放内存。
+   *
+   * @param ptr 由任意线程的 frame_pool 申请的内存。
+   * @param size 申请时的字节数。
+   */
+  void deallocate(void* ptr, std::size_t size) noexcept {
+    const std::size_t c = _class_of(size);
+    if (c >= _classes || _count[c] >= _limit) return ::operator delete(ptr);
+    block* b = static_cast<block*>(ptr);
+    b->next = _free[c];
+    _free[c] = b;
+    _count[c]++;
+  }
+  /**
+   * @brief 释放所有缓存的块。
+   */
+  void trim() noexcept {
+    for (std::size_t c = 0; c < _classes; c++) {
+      while (block* b = _free[c]) {
+        _free[c] = b->next;
+        ::operator delete(b);
+      }
+      _count[c] = 0;
+    }
+  }
+  /**
+   * @brief 设置每个级别最多缓存的块数。
+   */
+  inline void set_limit(std::size_t limit) noexcept {
+    _limit = limit;
+    for (std::size_t c = 0; c < _classes; c++) {
+      while (_count[c] > limit) {
+        block* b = _free[c];
+        _free[c] = b->next;
+        ::operator delete(b);
+        _count[c]--;
+      }
+    }
+  }
+  /**
+   * @brief 从当前线程的池申请内存。
+   */
+  static inline void* acquire(std::size_t size) {
+    if (frame_pool* pool = local()) return pool->allocate(size);
+    return ::operator new(size);
+  }
+  /**
+   * @brief 将内存归还给当前线程的池。
+   */
+  static inline void release(void* ptr, std::size_t size) noexcept {
+    if (frame_pool* pool = local())
+      pool->deallocate(ptr, size);
+    else
+      ::operator delete(ptr);
+  }
+};
+struct frame_pool::_holder {
+  frame_pool pool;
+  ~_holder() { _destroyed() = true; }
+};
+inline frame_pool* frame_pool::local() noexcept {
+  if (frame_pool* pool = _installed()) return pool;
+  if (_destroyed()) return nullptr;
+  static thread_local _holder holder;
+  return &holder.pool;
+}
+/**
+ * @brief 从当前线程的 frame_pool 申请内存的无状态分配器。对齐要求超过
+ * alignof(std::max_align_t) 的类型改用 std::allocator。
+ *
+ * @tparam T 元素类型。
+ */
+template <typename T>
+struct frame_allocator {
+  using value_type = T;
+  frame_allocator() noexcept = default;
+  template <typename U>
+  frame_allocator(const frame_allocator<U>&) noexcept {}
+  inline T* allocate(std::size_t n) {
+    if (alignof(T) > alignof(std::max_align_t))
+      return std::allocator<T>().allocate(n);
+    return static_cast<T*>(frame_pool::acquire(n * sizeof(T)));
+  }
+  inline void deallocate(T* ptr, std::size_t n) noexcept {
+    if (alignof(T) > alignof(std::max_align_t))
+      return std::allocator<T>().deallocate(ptr, n);
+    frame_pool::release(ptr, n * sizeof(T));
+  }
+  template <typename U>
+  inline bool operator==(const frame_allocator<U>&) const noexcept {
+    return true;
+  }
+  template <typename U>
+  inline bool operator!=(const frame_allocator<U>&) const noexcept {
+    return false;
+  }
+};
+};  // namespace detail
+};  // namespace awacorn
+#endif
+#endif
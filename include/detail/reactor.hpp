@@ -0,0 +1,239 @@
+#ifndef _AWACORN_REACTOR_
+#define _AWACORN_REACTOR_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#if !defined(AWACORN_USE_EPOLL) && !defined(AWACORN_NO_EPOLL)
+#if defined(__has_include)
+#if __has_include(<sys/epoll.h>)
+#define AWACORN_USE_EPOLL
+#endif
+#endif
+#endif
+#if defined(AWACORN_USE_EPOLL)
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "function.hpp"
+namespace awacorn {
+namespace detail {
+/**
+ * @brief 基于 epoll 的就绪通知 (reactor)。
+ *
+ * 每个等待者只触发一次。文件描述符以 EPOLLONESHOT
+ * 注册，触发后由 reactor 按剩余等待者重新设置关注的事件。
+ */
+class reactor {
+  struct waiter {
+    std::uint32_t events;
+    /**
+     * @brief 回调。参数为就绪的事件，或为负的 errno。
+     */
+    function<void(int)> fn;
+  };
+  int _fd;
+  std::size_t _pending;
+  std::unordered_map<int, std::vector<waiter>> _watch;
+  std::array<epoll_event, 64> _events;
+
+  static inline std::uint32_t _mask(const std::vector<waiter>& list) noexcept {
+    std::uint32_t mask = 0;
+    for (auto&& w : list) mask |= w.events;
+    return mask;
+  }
+  void _init() {
+    if (_fd != -1) return;
+    _fd = epoll_create1(EPOLL_CLOEXEC);
+    if (_fd == -1) throw std::system_error(errno, std::system_category());
+  }
+  // 重新设置 fd 关注的事件。fd 可能已被关闭 (自动移出 epoll)，
+  // 或仍以 ONESHOT 停用的状态留在 epoll 中。
+  void _arm(int fd, std::uint32_t mask) {
+    epoll_event ev;
+    ev.events = mask | EPOLLONESHOT;
+    ev.data.fd = fd;
+    if (epoll_ctl(_fd, EPOLL_CTL_MOD, fd, &ev) == 0) return;
+    if (errno == ENOENT && epoll_ctl(_fd, EPOLL_CTL_ADD, fd, &ev) == 0) return;
+    throw std::system_error(errno, std::system_category());
+  }
+  void _dispatch(int fd, std::uint32_t revents) {
+    auto it = _watch.find(fd);
+    if (it == _watch.end()) return;
+    std::vector<waiter> ready;
+    std::vector<waiter>& list = it->second;
+    for (auto w = list.begin(); w != list.end();) {
+      if (revents & (w->events | EPOLLERR | EPOLLHUP)) {
+        ready.push_back(std::move(*w));
+        w = list.erase(w);
+      } else {
+        w++;
+      }
+    }
+    if (list.empty()) {
+      _watch.erase(it);
+    } else {
+      try {
+        _arm(fd, _mask(list));
+      } catch (const std::system_error& err) {
+        for (auto&& w : list) ready.push_back(std::move(w));
+        _watch.erase(it);
+        _pending -= ready.size();
+        for (auto&& w : ready) w.fn(-err.code().value());
+        return;
+      }
+    }
+    _pending -= ready.size();
+    for (auto&& w : ready)
+      w.fn(int(revents & (w.events | EPOLLERR | EPOLLHUP)));
+  }
+
+ public:
+  reactor() : _fd(-1), _pending(0) {}
+  reactor(const reactor&) = delete;
+  reactor& operator=(const reactor&) = delete;
+  ~reactor() {
+    if (_fd != -1) close(_fd);
+  }
+  /**
+   * @brief 等待 fd 就绪。
+   *
+   * @param fd 文件描述符。
+   * @param events 关注的事件 (EPOLLIN / EPOLLOUT 等)。
+   * @param fn 就绪时调用的回调。
+   * @exception std::system_error 无法注册 fd 时抛出。
+   */
+  template <typename U>
+  void watch(int fd, std::uint32_t events, U&& fn) {
+    _init();
+    auto& list = _watch[fd];
+    std::uint32_t mask = _mask(list);
+    if ((mask | events) != mask || list.empty()) {
+      try {
+        _arm(fd, mask | events);
+      } catch (...) {
+        if (list.empty()) _watch.erase(fd);
+        throw;
+      }
+    }
+    list.push_back(waiter{events, function<void(int)>(std::forward<U>(fn))});
+    _pending++;
+  }
+  /**
+   * @brief 取消 fd 上的所有等待者，等待者将收到 -ECANCELED。
+   *
+   * @param fd 文件描述符。
+   */
+  void cancel(int fd) {
+    auto it = _watch.find(fd);
+    if (it == _watch.end()) return;
+    std::vector<waiter> list = std::move(it->second);
+    _watch.erase(it);
+    epoll_ctl(_fd, EPOLL_CTL_DEL, fd, nullptr);
+    _pending -= list.size();
+    for (auto&& w : list) w.fn(-ECANCELED);
+  }
+  /**
+   * @brief 等待并分发就绪事件。
+   *
+   * @param timeout 最长等待时间。负值表示无限等待。
+   */
+  void wait(const std::chrono::steady_clock::duration& timeout) {
+    int ms = -1;
+    if (timeout >= std::chrono::steady_clock::duration(0)) {
+      // 向上取整，避免在到期前反复醒来。
+      auto tm = std::chrono::duration_cast<std::chrono::milliseconds>(
+          timeout + std::chrono::milliseconds(1) -
+          std::chrono::steady_clock::duration(1));
+      ms = tm.count() > 0x7fffffff ? 0x7fffffff : int(tm.count());
+    }
+    int n = epoll_wait(_fd, _events.data(), int(_events.size()), ms);
+    if (n == -1) {
+      if (errno == EINTR) return;
+      throw std::system_error(errno, std::system_category());
+    }
+    for (int i = 0; i < n; i++)
+      _dispatch(_events[i].data.fd, _events[i].events);
+  }
+  /**
+   * @brief 以边缘触发的方式持续关注 fd 的可读事件，用于唤醒 wait()。
+   *
+   * 这样的 fd 不计入等待者，也不会被分发。
+   *
+   * @param fd 文件描述符。
+   * @exception std::system_error 无法注册 fd 时抛出。
+   */
+  void attach(int fd) {
+    _init();
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = fd;
+    if (epoll_ctl(_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+      throw std::system_error(errno, std::system_category());
+  }
+  /**
+   * @brief epoll 实例的文件描述符，尚未创建时为 -1。
+   */
+  inline int fd() const noexcept { return _fd; }
+  /**
+   * @brief 是否没有等待者。
+   */
+  inline bool empty() const noexcept { return !_pending; }
+};
+/**
+ * @brief 基于 eventfd 的跨线程唤醒。
+ */
+class notifier {
+  int _fd;
+
+ public:
+  notifier() : _fd(-1) {}
+  notifier(const notifier&) = delete;
+  notifier& operator=(const notifier&) = delete;
+  ~notifier() {
+    if (_fd != -1) close(_fd);
+  }
+  /**
+   * @brief 创建 eventfd。只能在其它线程调用 notify() 之前调用。
+   *
+   * @return int eventfd 的文件描述符。
+   * @exception std::system_error 无法创建 eventfd 时抛出。
+   */
+  int fd() {
+    if (_fd != -1) return _fd;
+    _fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_fd == -1) throw std::system_error(errno, std::system_category());
+    return _fd;
+  }
+  /**
+   * @brief 唤醒。线程安全。
+   */
+  inline void notify() const noexcept {
+    std::uint64_t v = 1;
+    ssize_t ret = ::write(_fd, &v, sizeof(v));
+    (void)ret;
+  }
+  /**
+   * @brief 清除计数。
+   */
+  inline void clear() const noexcept {
+    std::uint64_t v;
+    ssize_t ret = ::read(_fd, &v, sizeof(v));
+    (void)ret;
+  }
+};
+};  // namespace detail
+};  // namespace awacorn
+#endif
+#endif
+#endif
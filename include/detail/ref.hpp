@@ -0,0 +1,149 @@
+#ifndef _AWACORN_REF_
+#define _AWACORN_REF_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+namespace awacorn {
+/**
+ * @brief 构造线程安全 (以原子操作维护引用计数) 的对象的标记，见 promise。
+ */
+struct thread_safe_t {
+  explicit constexpr thread_safe_t() noexcept {}
+};
+constexpr thread_safe_t thread_safe{};
+namespace detail {
+/**
+ * @brief 侵入式引用计数的基类。计数与对象位于同一次分配中，没有单独的控制块。
+ *
+ * 定义了 AWACORN_SINGLE_THREAD 时，计数默认以普通的读写维护，对象只能在
+ * 一个线程上使用；否则默认使用原子操作。构造时指定了 atomic 的对象总是
+ * 使用原子操作，可以在线程之间共享。
+ */
+class ref_base {
+  std::atomic<std::size_t> _refs;
+  bool _atomic;
+  /**
+   * @brief 析构对象并归还内存，由 make_ref 设定。
+   */
+  void (*_release)(ref_base*) noexcept;
+  template <typename T, typename Alloc>
+  friend struct ref_holder;
+  template <typename T, typename Alloc, typename... Args>
+  friend T* make_ref(const Alloc& alloc, bool atomic, Args&&... args);
+
+ public:
+#if defined(AWACORN_SINGLE_THREAD)
+  static constexpr bool default_atomic = false;
+#else
+  static constexpr bool default_atomic = true;
+#endif
+  ref_base() noexcept
+      : _refs(1), _atomic(default_atomic), _release(nullptr) {}
+  ref_base(const ref_base&) = delete;
+  ref_base& operator=(const ref_base&) = delete;
+  inline void retain() noexcept {
+    if (_atomic)
+      _refs.fetch_add(1, std::memory_order_relaxed);
+    else
+      _refs.store(_refs.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+  inline void release() noexcept {
+    std::size_t left;
+    if (_atomic) {
+      left = _refs.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    } else {
+      left = _refs.load(std::memory_order_relaxed) - 1;
+      _refs.store(left, std::memory_order_relaxed);
+    }
+    if (!left) _release(this);
+  }
+};
+/**
+ * @brief 在对象之后保存分配器，用于释放时归还内存。空的分配器不占空间。
+ */
+template <typename T, typename Alloc>
+struct ref_holder : T, private Alloc {
+  using allocator_type = typename std::allocator_traits<
+      Alloc>::template rebind_alloc<ref_holder>;
+  template <typename... Args>
+  explicit ref_holder(const Alloc& alloc, Args&&... args)
+      : T(std::forward<Args>(args)...), Alloc(alloc) {}
+  static void destroy(ref_base* base) noexcept {
+    ref_holder* self = static_cast<ref_holder*>(static_cast<T*>(base));
+    allocator_type alloc(static_cast<const Alloc&>(*self));
+    self->~ref_holder();
+    std::allocator_traits<allocator_type>::deallocate(alloc, self, 1);
+  }
+};
+/**
+ * @brief 使用分配器创建以 ref_base 计数的对象，初始引用计数为 1。
+ *
+ * @param alloc 分配器。
+ * @param atomic 是否以原子操作维护引用计数。
+ * @param args 构造参数。
+ * @return T* 对象，由 ref_ptr 接管。
+ */
+template <typename T, typename Alloc, typename... Args>
+T* make_ref(const Alloc& alloc, bool atomic, Args&&... args) {
+  using holder = ref_holder<T, Alloc>;
+  typename holder::allocator_type a(alloc);
+  holder* ptr = std::allocator_traits<decltype(a)>::allocate(a, 1);
+  try {
+    ::new (static_cast<void*>(ptr))
+        holder(alloc, std::forward<Args>(args)...);
+  } catch (...) {
+    std::allocator_traits<decltype(a)>::deallocate(a, ptr, 1);
+    throw;
+  }
+  ptr->_atomic = atomic;
+  ptr->_release = &holder::destroy;
+  return ptr;
+}
+/**
+ * @brief 侵入式智能指针，只占一个指针的大小。
+ *
+ * @tparam T 派生自 ref_base 的类型。
+ */
+template <typename T>
+class ref_ptr {
+  T* _ptr;
+
+ public:
+  constexpr ref_ptr() noexcept : _ptr(nullptr) {}
+  /**
+   * @brief 接管 make_ref 返回的对象，不增加引用计数。
+   */
+  explicit ref_ptr(T* ptr) noexcept : _ptr(ptr) {}
+  ref_ptr(const ref_ptr& rhs) noexcept : _ptr(rhs._ptr) {
+    if (_ptr) _ptr->retain();
+  }
+  ref_ptr(ref_ptr&& rhs) noexcept : _ptr(rhs._ptr) { rhs._ptr = nullptr; }
+  ~ref_ptr() {
+    if (_ptr) _ptr->release();
+  }
+  ref_ptr& operator=(const ref_ptr& rhs) noexcept {
+    ref_ptr(rhs).swap(*this);
+    return *this;
+  }
+  ref_ptr& operator=(ref_ptr&& rhs) noexcept {
+    ref_ptr(std::move(rhs)).swap(*this);
+    return *this;
+  }
+  inline void swap(ref_ptr& rhs) noexcept { std::swap(_ptr, rhs._ptr); }
+  inline T* get() const noexcept { return _ptr; }
+  inline T* operator->() const noexcept { return _ptr; }
+  inline T& operator*() const noexcept { return *_ptr; }
+  inline explicit operator bool() const noexcept { return _ptr != nullptr; }
+};
+};  // namespace detail
+};  // namespace awacorn
+#endif
+#endif
@@ -0,0 +1,500 @@
+#ifndef _AWACORN_STACK_
+#define _AWACORN_STACK_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#if !defined(AWACORN_USE_MMAP_STACK) && !defined(AWACORN_NO_MMAP_STACK)
+#if defined(__has_include)
+#if __has_include(<sys/mman.h>) && __has_include(<unistd.h>)
+#define AWACORN_USE_MMAP_STACK
+#endif
+#endif
+#endif
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#if defined(AWACORN_USE_MMAP_STACK)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+namespace awacorn {
+namespace detail {
+/**
+ * @brief 按大小分级的协程栈池，不是线程安全的。
+ *
+ * 栈的大小向上取整到 2 的幂 (至少 min_size)。协程结束后栈回到当前线程的
+ * 池中，供之后相同级别的协程复用；超过上限的栈直接释放。
+ *
+ * 定义了 AWACORN_USE_MMAP_STACK 时 (会自动检测；可以用
+ * AWACORN_NO_MMAP_STACK 关闭)，栈由 mmap 映射，内核在第一次访问时才分配
+ * 物理页，并且栈底 (低地址) 之下有一个不可访问的保护页，栈溢出会触发
+ * SIGSEGV 而不是破坏其它内存。
+ */
+class stack_pool {
+  static constexpr std::size_t _classes = sizeof(std::size_t) * 8;
+  std::array<std::vector<void*>, _classes> _free;
+  std::size_t _limit;
+  std::size_t _capacity;
+  std::size_t _cached;
+  std::size_t _shared_count;
+  std::size_t _shared_size;
+  std::size_t _shared_next;
+
+  static inline std::size_t _class_of(std::size_t size) noexcept {
+    std::size_t c = 0;
+    while ((std::size_t(1) << c) < size) c++;
+    return c;
+  }
+  static inline bool& _destroyed() noexcept {
+    static thread_local bool destroyed = false;
+    return destroyed;
+  }
+  struct _holder;
+#if defined(AWACORN_USE_MMAP_STACK)
+  static inline std::size_t _guard_size() noexcept {
+    static const std::size_t size = std::size_t(sysconf(_SC_PAGESIZE));
+    return size;
+  }
+  static inline void* _map(std::size_t size) noexcept {
+    const std::size_t guard = _guard_size();
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+    flags |= MAP_NORESERVE;
+#endif
+#if defined(MAP_STACK)
+    flags |= MAP_STACK;
+#endif
+    void* base = mmap(nullptr, size + guard, PROT_READ | PROT_WRITE, flags,
+                      -1, 0);
+    if (base == MAP_FAILED) return nullptr;
+    if (mprotect(base, guard, PROT_NONE)) {
+      munmap(base, size + guard);
+      return nullptr;
+    }
+    return static_cast<char*>(base) + guard;
+  }
+  static inline void _unmap(void* ptr, std::size_t size) noexcept {
+    const std::size_t guard = _guard_size();
+    munmap(static_cast<char*>(ptr) - guard, size + guard);
+  }
+  /**
+   * @brief 交还栈的物理页，映射保持不变，再次访问时重新分配零页。
+   */
+  static inline void _discard(void* ptr, std::size_t size) noexcept {
+#if defined(MADV_DONTNEED)
+    madvise(ptr, size, MADV_DONTNEED);
+#else
+    (void)ptr;
+    (void)size;
+#endif
+  }
+#else
+  static inline void* _map(std::size_t size) noexcept {
+    return std::malloc(size);
+  }
+  static inline void _unmap(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+  }
+  static inline void _discard(void*, std::size_t) noexcept {}
+#endif
+
+ public:
+  /**
+   * @brief 共享栈。多个协程轮流在同一个栈上运行，由上下文实现负责在切换时
+   * 保存和恢复各协程用到的部分。
+   */
+  struct shared_stack {
+    char* base;
+    std::size_t size;
+    /**
+     * @brief 栈上当前保存着哪个协程的数据，由上下文实现解释。
+     */
+    void* occupant;
+  };
+
+ private:
+  std::vector<shared_stack> _shared;
+
+ public:
+  /**
+   * @brief 最小的栈大小。
+   */
+  static constexpr std::size_t min_size = 16 * 1024;
+  /**
+   * @brief 构造栈池。
+   *
+   * @param limit 每个级别最多缓存的栈数量。
+   * @param capacity 最多缓存的总字节数。
+   */
+  explicit stack_pool(std::size_t limit = 64,
+                      std::size_t capacity = 64 * 1024 * 1024) noexcept
+      : _limit(limit),
+        _capacity(capacity),
+        _cached(0),
+        _shared_count(4),
+        _shared_size(1024 * 1024),
+        _shared_next(0) {}
+  stack_pool(const stack_pool&) = delete;
+  stack_pool& operator=(const stack_pool&) = delete;
+  ~stack_pool() {
+    trim();
+    for (auto&& stack : _shared) _unmap(stack.base, stack.size);
+  }
+  /**
+   * @brief 当前线程的栈池。线程退出、栈池析构之后返回 nullptr。
+   */
+  static inline stack_pool* local() noexcept;
+  /**
+   * @brief 将栈大小向上取整到所属级别的大小。
+   *
+   * @param size 栈大小。
+   * @return std::size_t 实际分配的栈大小。
+   */
+  static inline std::size_t round(std::size_t size) noexcept {
+    return std::size_t(1)
+           << _class_of(size < min_size ? std::size_t(min_size) : size);
+  }
+  /**
+   * @brief 取得一个栈。
+   *
+   * @param size 栈大小，必须已经由 round 取整。
+   * @return void* 栈的低地址。
+   * @exception std::bad_alloc 内存不足时抛出。
+   */
+  void* allocate(std::size_t size) {
+    std::vector<void*>& bucket = _free[_class_of(size)];
+    if (!bucket.empty()) {
+      void* ptr = bucket.back();
+      bucket.pop_back();
+      _cached -= size;
+      return ptr;
+    }
+    // 预留归还的位置，使协程结束时通常不需要申请内存。
+    if (!bucket.capacity()) bucket.reserve(_limit < 16 ? _limit : 16);
+    if (void* ptr = _map(size)) return ptr;
+    throw std::bad_alloc();
+  }
+  /**
+   * @brief 归还一个栈。超过上限时直接释放。
+   *
+   * @param ptr allocate 返回的地址。
+   * @param size 栈大小。
+   */
+  void deallocate(void* ptr, std::size_t size) noexcept {
+    std::vector<void*>& bucket = _free[_class_of(size)];
+    if (bucket.size() < _limit && _cached + size <= _capacity) {
+      try {
+        bucket.push_back(ptr);
+        _cached += size;
+        return;
+      } catch (...) {
+      }
+    }
+    _unmap(ptr, size);
+  }
+  /**
+   * @brief 释放缓存的栈，直到缓存的总字节数不超过 keep。
+   *
+   * @param keep 保留的字节数。
+   */
+  void trim(std::size_t keep = 0) noexcept {
+    for (std::size_t c = _classes; c > 0 && _cached > keep; c--) {
+      std::vector<void*>& bucket = _free[c - 1];
+      while (!bucket.empty() && _cached > keep) {
+        _unmap(bucket.back(), std::size_t(1) << (c - 1));
+        bucket.pop_back();
+        _cached -= std::size_t(1) << (c - 1);
+      }
+    }
+  }
+  /**
+   * @brief 设置每个级别最多缓存的栈数量。为 0 时不缓存。
+   */
+  inline void set_limit(std::size_t limit) noexcept {
+    _limit = limit;
+    for (auto&& bucket : _free) {
+      while (bucket.size() > limit) {
+        const std::size_t size = std::size_t(1) << (&bucket - &_free[0]);
+        _cached -= size;
+        _unmap(bucket.back(), size);
+        bucket.pop_back();
+      }
+    }
+  }
+  /**
+   * @brief 设置最多缓存的总字节数。
+   */
+  inline void set_capacity(std::size_t capacity) noexcept {
+    _capacity = capacity;
+    trim(capacity);
+  }
+  /**
+   * @brief 当前缓存的总字节数。
+   */
+  inline std::size_t cached() const noexcept { return _cached; }
+  /**
+   * @brief 设置共享栈的数量和大小 (默认 4 个 1 MiB 的栈)。只能在当前线程
+   * 创建第一个共享栈之前设置。
+   *
+   * @param count 共享栈的数量，至少为 1。
+   * @param size 每个共享栈的大小。
+   * @return bool 是否设置成功。
+   */
+  inline bool set_shared(std::size_t count, std::size_t size) noexcept {
+    if (!_shared.empty()) return false;
+    _shared_count = count ? count : 1;
+    _shared_size = round(size);
+    return true;
+  }
+  /**
+   * @brief 依次轮流取得共享栈。共享栈在首次使用时创建，随栈池一起释放。
+   *
+   * @return shared_stack& 共享栈，地址在栈池的生命周期内不变。
+   * @exception std::bad_alloc 内存不足时抛出。
+   */
+  shared_stack& shared() {
+    if (_shared.size() < _shared_count) {
+      // 预留全部位置，使已经交出的引用不会失效。
+      _shared.reserve(_shared_count);
+      char* base = static_cast<char*>(_map(_shared_size));
+      if (!base) throw std::bad_alloc();
+      _shared.push_back(shared_stack{base, _shared_size, nullptr});
+      return _shared.back();
+    }
+    return _shared[_shared_next++ % _shared.size()];
+  }
+  /**
+   * @brief 从当前线程的栈池取得栈。
+   *
+   * @param size 栈大小，必须已经由 round 取整。
+   * @return void* 栈的低地址。
+   */
+  static inline void* acquire(std::size_t size) {
+    if (stack_pool* pool = local()) return pool->allocate(size);
+    if (void* ptr = _map(size)) return ptr;
+    throw std::bad_alloc();
+  }
+  /**
+   * @brief 将栈归还给当前线程的栈池。栈可以在任意线程归还。
+   *
+   * @param ptr acquire 返回的地址。
+   * @param size 栈大小。
+   * @param dirty 栈是否被整个写过 (比如被 stack_site 填充)。为 true 时先将
+   * 物理页交还给系统，之后复用它的协程只占用实际用到的部分。
+   */
+  static inline void release(void* ptr, std::size_t size,
+                             bool dirty = false) noexcept {
+    if (dirty) _discard(ptr, size);
+    if (stack_pool* pool = local())
+      pool->deallocate(ptr, size);
+    else
+      _unmap(ptr, size);
+  }
+};
+struct stack_pool::_holder {
+  stack_pool pool;
+  ~_holder() { _destroyed() = true; }
+};
+inline stack_pool* stack_pool::local() noexcept {
+  if (_destroyed()) return nullptr;
+  static thread_local _holder holder;
+  return &holder.pool;
+}
+/**
+ * @brief 协程栈的调用点 (或标签)，线程安全。
+ *
+ * 被抽样的协程的栈会预先填充固定的字节，协程结束时从栈底向上找到第一个
+ * 被改写的字节，得到栈的峰值用量。填充会使整个栈都被实际分配，因此只抽样
+ * 前 warmup 个协程，之后每 interval 个协程抽样一个；栈归还时交还填充过的
+ * 物理页。
+ *
+ * 自适应模式下，收集到足够的样本后，之后的协程使用按峰值加上余量取整的栈
+ * 大小 (不超过 max_size)；峰值继续增长时栈大小也随之增长。
+ */
+class stack_site {
+ public:
+  /**
+   * @brief 每个被抽样的协程结束时调用，参数为调用点和该协程的栈用量。
+   */
+  using report_fn = void (*)(const stack_site& site, std::size_t usage);
+
+ private:
+  const char* _name;
+  std::size_t _initial;
+  std::atomic<bool> _adaptive;
+  std::atomic<std::size_t> _margin;
+  std::atomic<std::size_t> _max;
+  std::atomic<std::size_t> _interval;
+  std::atomic<std::size_t> _spawned;
+  std::atomic<std::size_t> _samples;
+  std::atomic<std::size_t> _peak;
+  std::atomic<std::size_t> _total;
+  std::atomic<report_fn> _report;
+
+ public:
+  /**
+   * @brief 填充栈使用的字节。
+   */
+  static constexpr unsigned char pattern = 0xA5;
+  /**
+   * @brief 自适应模式下开始调整栈大小前需要的样本数。
+   */
+  static constexpr std::size_t warmup = 16;
+  /**
+   * @brief 自适应模式下栈大小的默认上限。
+   */
+  static constexpr std::size_t max_size = 8 * 1024 * 1024;
+  /**
+   * @brief 构造调用点。
+   *
+   * @param name 调用点的名称，可以为 nullptr。
+   * @param size 初始的栈大小。
+   * @param adaptive 是否启用自适应模式。
+   */
+  explicit stack_site(const char* name = nullptr,
+                      std::size_t size = 1024 * 1024,
+                      bool adaptive = false) noexcept
+      : _name(name),
+        _initial(stack_pool::round(size)),
+        _adaptive(adaptive),
+        _margin(100),
+        _max(max_size),
+        _interval(16),
+        _spawned(0),
+        _samples(0),
+        _peak(0),
+        _total(0),
+        _report(nullptr) {}
+  stack_site(const stack_site&) = delete;
+  stack_site& operator=(const stack_site&) = delete;
+  inline const char* name() const noexcept { return _name; }
+  /**
+   * @brief 在此创建的下一个协程使用的栈大小。
+   */
+  std::size_t size() const noexcept {
+    if (!_adaptive.load(std::memory_order_relaxed) ||
+        _samples.load(std::memory_order_relaxed) < warmup)
+      return _initial;
+    std::size_t peak = _peak.load(std::memory_order_relaxed);
+    std::size_t size = stack_pool::round(
+        peak + peak * _margin.load(std::memory_order_relaxed) / 100);
+    std::size_t max = _max.load(std::memory_order_relaxed);
+    return size < max ? size : max;
+  }
+  /**
+   * @brief 在此创建的下一个协程是否被抽样 (填充栈并报告用量)。每次调用都
+   * 计为创建了一个协程。
+   */
+  bool sample() noexcept {
+    std::size_t n = _spawned.fetch_add(1, std::memory_order_relaxed);
+    if (n < warmup) return true;
+    std::size_t interval = _interval.load(std::memory_order_relaxed);
+    return interval && (n - warmup) % interval == 0;
+  }
+  /**
+   * @brief 启用或关闭自适应模式。
+   */
+  inline void set_adaptive(bool adaptive) noexcept {
+    _adaptive.store(adaptive, std::memory_order_relaxed);
+  }
+  /**
+   * @brief 设置自适应模式下在峰值之上预留的余量 (百分比，默认 100)。
+   */
+  inline void set_margin(std::size_t percent) noexcept {
+    _margin.store(percent, std::memory_order_relaxed);
+  }
+  /**
+   * @brief 设置自适应模式下栈大小的上限 (默认 max_size)。可以大于初始大小，
+   * 使峰值接近栈大小的调用点的栈随之增长。
+   */
+  inline void set_max_size(std::size_t size) noexcept {
+    _max.store(stack_pool::round(size), std::memory_order_relaxed);
+  }
+  /**
+   * @brief 设置预热之后的抽样间隔：每 interval 个协程抽样一个 (默认 16)。
+   * 为 1 时抽样所有协程，为 0 时预热之后不再抽样。
+   */
+  inline void set_sample_interval(std::size_t interval) noexcept {
+    _interval.store(interval, std::memory_order_relaxed);
+  }
+  /**
+   * @brief 设置每个被抽样的协程结束时的回调，nullptr 表示不报告。回调在
+   * 协程栈上调用，不应占用过多的栈或抛出异常。
+   */
+  inline void set_report(report_fn report) noexcept {
+    _report.store(report, std::memory_order_relaxed);
+  }
+  /**
+   * @brief 已结束的被抽样的协程数量。
+   */
+  inline std::size_t samples() const noexcept {
+    return _samples.load(std::memory_order_relaxed);
+  }
+  /**
+   * @brief 被抽样的协程中栈用量的最大值 (字节)。
+   */
+  inline std::size_t peak() const noexcept {
+    return _peak.load(std::memory_order_relaxed);
+  }
+  /**
+   * @brief 被抽样的协程栈用量的平均值 (字节)。
+   */
+  inline std::size_t average() const noexcept {
+    std::size_t samples = _samples.load(std::memory_order_relaxed);
+    return samples ? _total.load(std::memory_order_relaxed) / samples : 0;
+  }
+  /**
+   * @brief 记录一个协程的栈用量。
+   *
+   * @param usage 栈用量 (字节)。
+   */
+  void record(std::size_t usage) noexcept {
+    std::size_t peak = _peak.load(std::memory_order_relaxed);
+    while (usage > peak && !_peak.compare_exchange_weak(
+                               peak, usage, std::memory_order_relaxed)) {
+    }
+    _total.fetch_add(usage, std::memory_order_relaxed);
+    _samples.fetch_add(1, std::memory_order_relaxed);
+    if (report_fn report = _report.load(std::memory_order_relaxed))
+      report(*this, usage);
+  }
+  /**
+   * @brief 以 pattern 填充栈。
+   *
+   * @param low 栈的低地址。
+   * @param size 栈大小。
+   */
+  static inline void paint(void* low, std::size_t size) noexcept {
+    std::memset(low, pattern, size);
+  }
+  /**
+   * @brief 计算填充过的栈的用量。
+   *
+   * @param low 栈的低地址。
+   * @param size 栈大小。
+   * @return std::size_t 从栈顶到最低的被改写字节的距离。
+   */
+  static std::size_t measure(const void* low, std::size_t size) noexcept {
+    const unsigned char* p = static_cast<const unsigned char*>(low);
+    const unsigned char* end = p + size;
+    // 按字比较，栈由 stack_pool 分配，低地址总是对齐的。
+    std::uintptr_t word;
+    std::memset(&word, pattern, sizeof(word));
+    while (p + sizeof(word) <= end &&
+           *reinterpret_cast<const std::uintptr_t*>(p) == word)
+      p += sizeof(word);
+    while (p < end && *p == pattern) p++;
+    return std::size_t(end - p);
+  }
+};
+};  // namespace detail
+};  // namespace awacorn
+#endif
+#endif
@@ -0,0 +1,337 @@
+#ifndef _AWACORN_TIMER_
+#define _AWACORN_TIMER_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+namespace awacorn {
+namespace detail {
+/**
+ * @brief 定时器节点，由定时事件继承。
+ */
+struct timer_node {
+  /**
+   * @brief 触发的绝对时间。
+   */
+  std::chrono::steady_clock::time_point deadline;
+  /**
+   * @brief 注册序号。触发时间相同的节点按注册顺序触发。
+   */
+  std::size_t seq;
+  /**
+   * @brief 节点在所属队列中的位置 (堆下标或时间轮的桶编号)。
+   */
+  std::size_t index;
+  /**
+   * @brief 时间轮中的链表指针。
+   */
+  timer_node* prev;
+  timer_node* next;
+};
+/**
+ * @brief 定时器队列的接口。
+ */
+struct timer_queue {
+  virtual ~timer_queue() = default;
+  /**
+   * @brief 插入节点。
+   *
+   * @param node 节点，需已设置 deadline 和 seq。
+   */
+  virtual void push(timer_node* node) = 0;
+  /**
+   * @brief 删除队列中的任意节点。
+   *
+   * @param node 节点，必须位于队列中。
+   */
+  virtual void erase(timer_node* node) noexcept = 0;
+  /**
+   * @brief 取出一个已到期的节点。
+   *
+   * @param now 当前时间。
+   * @param limit 只取出 seq 小于 limit 的节点。
+   * @return timer_node* 到期的节点，没有则返回 nullptr。
+   */
+  virtual timer_node* pop(const std::chrono::steady_clock::time_point& now,
+                          std::size_t limit) noexcept = 0;
+  /**
+   * @brief 下一个节点最早可能的触发时间。队列不能为空。
+   *
+   * @return std::chrono::steady_clock::time_point
+   * 触发时间的下界，实际触发时间不会早于它。
+   */
+  virtual std::chrono::steady_clock::time_point next() const noexcept = 0;
+  virtual bool empty() const noexcept = 0;
+};
+/**
+ * @brief 按 (deadline, seq) 排序的最小堆。插入、删除均为 O(log n)。
+ */
+class timer_heap final : public timer_queue {
+  std::vector<timer_node*> _heap;
+  static inline bool _less(const timer_node* a, const timer_node* b) noexcept {
+    return a->deadline < b->deadline ||
+           (a->deadline == b->deadline && a->seq < b->seq);
+  }
+  inline void _place(timer_node* node, std::size_t index) noexcept {
+    _heap[index] = node;
+    node->index = index;
+  }
+  void _sift_up(std::size_t index) noexcept {
+    timer_node* node = _heap[index];
+    while (index > 0) {
+      std::size_t parent = (index - 1) / 2;
+      if (!_less(node, _heap[parent])) break;
+      _place(_heap[parent], index);
+      index = parent;
+    }
+    _place(node, index);
+  }
+  void _sift_down(std::size_t index) noexcept {
+    timer_node* node = _heap[index];
+    const std::size_t size = _heap.size();
+    for (;;) {
+      std::size_t child = index * 2 + 1;
+      if (child >= size) break;
+      if (child + 1 < size && _less(_heap[child + 1], _heap[child])) child++;
+      if (!_less(_heap[child], node)) break;
+      _place(_heap[child], index);
+      index = child;
+    }
+    _place(node, index);
+  }
+
+ public:
+  /**
+   * @brief 插入节点。
+   *
+   * @param node 节点，需已设置 deadline 和 seq。
+   */
+  void push(timer_node* node) override {
+    _heap.push_back(node);
+    _sift_up(_heap.size() - 1);
+  }
+  /**
+   * @brief 删除堆中的任意节点。
+   *
+   * @param node 节点，必须位于堆中。
+   */
+  void erase(timer_node* node) noexcept override {
+    std::size_t index = node->index;
+    timer_node* last = _heap.back();
+    _heap.pop_back();
+    if (last == node) return;
+    _place(last, index);
+    if (index > 0 && _less(last, _heap[(index - 1) / 2]))
+      _sift_up(index);
+    else
+      _sift_down(index);
+  }
+  timer_node* pop(const std::chrono::steady_clock::time_point& now,
+                  std::size_t limit) noexcept override {
+    if (_heap.empty()) return nullptr;
+    timer_node* node = _heap.front();
+    if (node->deadline > now || node->seq >= limit) return nullptr;
+    erase(node);
+    return node;
+  }
+  std::chrono::steady_clock::time_point next() const noexcept override {
+    return _heap.front()->deadline;
+  }
+  bool empty() const noexcept override { return _heap.empty(); }
+};
+/**
+ * @brief 分层时间轮。插入、删除、到期均为 O(1)，
+ * 适用于大量且多数会被取消的定时器。
+ *
+ * 时间被划分为 granularity 长度的 tick，节点在其 deadline
+ * 向上取整所在的 tick 到期，因此不会早于 deadline 触发。
+ */
+class timer_wheel final : public timer_queue {
+  struct bucket {
+    timer_node* head;
+    timer_node* tail;
+  };
+  static constexpr std::size_t _bits = 6;
+  static constexpr std::size_t _slots = std::size_t(1) << _bits;
+  static constexpr std::uint64_t _mask = _slots - 1;
+  static constexpr std::size_t _levels = 8;
+  // 已到期节点所在的桶编号。
+  static constexpr std::size_t _expired = _levels * _slots;
+
+  std::chrono::steady_clock::duration _granularity;
+  std::chrono::steady_clock::time_point _origin;
+  // 已处理到的 tick。
+  std::uint64_t _tick;
+  std::size_t _size;
+  std::array<std::uint64_t, _levels> _bitmap;
+  std::array<bucket, _expired + 1> _bucket;
+
+  static inline std::size_t _ctz(std::uint64_t v) noexcept {
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    std::size_t n = 0;
+    while (!(v & 1)) v >>= 1, n++;
+    return n;
+#endif
+  }
+  inline std::uint64_t _tick_of(
+      const std::chrono::steady_clock::time_point& tm) const noexcept {
+    if (tm <= _origin) return 0;
+    auto d = tm - _origin;
+    return std::uint64_t(
+        (d + _granularity - std::chrono::steady_clock::duration(1)) /
+        _granularity);
+  }
+  inline void _link(timer_node* node, std::size_t index) noexcept {
+    bucket& b = _bucket[index];
+    node->index = index;
+    node->next = nullptr;
+    node->prev = b.tail;
+    if (b.tail)
+      b.tail->next = node;
+    else
+      b.head = node;
+    b.tail = node;
+    if (index < _expired)
+      _bitmap[index / _slots] |= std::uint64_t(1) << (index % _slots);
+  }
+  inline void _unlink(timer_node* node) noexcept {
+    bucket& b = _bucket[node->index];
+    if (node->prev)
+      node->prev->next = node->next;
+    else
+      b.head = node->next;
+    if (node->next)
+      node->next->prev = node->prev;
+    else
+      b.tail = node->prev;
+    if (!b.head && node->index < _expired)
+      _bitmap[node->index / _slots] &=
+          ~(std::uint64_t(1) << (node->index % _slots));
+  }
+  void _place(timer_node* node) noexcept {
+    std::uint64_t tick = _tick_of(node->deadline);
+    if (tick <= _tick) return _link(node, _expired);
+    std::uint64_t diff = tick - _tick;
+    std::size_t level = 0;
+    while (level + 1 < _levels &&
+           diff >= (std::uint64_t(1) << (_bits * (level + 1))))
+      level++;
+    if (level + 1 == _levels &&
+        diff >= (std::uint64_t(1) << (_bits * _levels)) - 1) {
+      // 超出范围的节点暂存于最高层，级联时会重新放置。
+      tick = _tick + (std::uint64_t(1) << (_bits * _levels)) - 1;
+    }
+    _link(node, level * _slots + ((tick >> (_bits * level)) & _mask));
+  }
+  // 下一个可能有工作 (到期或级联) 的 tick。
+  std::uint64_t _next_tick() const noexcept {
+    for (std::size_t level = 0; level < _levels; level++) {
+      const std::size_t shift = _bits * level;
+      const std::uint64_t offset = (_tick >> shift) & _mask;
+      if (!_bitmap[level]) continue;
+      std::uint64_t pending =
+          offset == _mask ? 0
+                          : (_bitmap[level] >> (offset + 1)) << (offset + 1);
+      if (pending)
+        return (((_tick >> shift) & ~_mask) | _ctz(pending)) << shift;
+      // 回绕的槽在上一层的下一个周期才会处理。
+      return ((_tick >> (shift + _bits)) + 1) << (shift + _bits);
+    }
+    return UINT64_MAX;
+  }
+  void _advance(std::uint64_t target) noexcept {
+    while (_tick < target) {
+      std::uint64_t next = _next_tick();
+      if (next > target) {
+        _tick = target;
+        return;
+      }
+      _tick = next;
+      for (std::size_t level = _levels - 1; level > 0; level--) {
+        const std::size_t shift = _bits * level;
+        if (_tick & ((std::uint64_t(1) << shift) - 1)) continue;
+        bucket& b = _bucket[level * _slots + ((_tick >> shift) & _mask)];
+        timer_node* node = b.head;
+        b.head = b.tail = nullptr;
+        _bitmap[level] &= ~(std::uint64_t(1) << ((_tick >> shift) & _mask));
+        while (node) {
+          timer_node* next_node = node->next;
+          _place(node);
+          node = next_node;
+        }
+      }
+      bucket& b = _bucket[_tick & _mask];
+      if (b.head) {
+        bucket& e = _bucket[_expired];
+        for (timer_node* node = b.head; node; node = node->next)
+          node->index = _expired;
+        if (e.tail) {
+          e.tail->next = b.head;
+          b.head->prev = e.tail;
+        } else {
+          e.head = b.head;
+        }
+        e.tail = b.tail;
+        b.head = b.tail = nullptr;
+        _bitmap[0] &= ~(std::uint64_t(1) << (_tick & _mask));
+      }
+    }
+  }
+
+ public:
+  /**
+   * @brief 构造时间轮。
+   *
+   * @param granularity 每个 tick 的长度。
+   * @param origin 第 0 个 tick 的时间。
+   */
+  explicit timer_wheel(const std::chrono::steady_clock::duration& granularity,
+                       const std::chrono::steady_clock::time_point& origin =
+                           std::chrono::steady_clock::now())
+      : _granularity(granularity > std::chrono::steady_clock::duration(0)
+                         ? granularity
+                         : std::chrono::steady_clock::duration(1)),
+        _origin(origin),
+        _tick(0),
+        _size(0),
+        _bitmap(),
+        _bucket() {}
+  timer_wheel(const timer_wheel&) = delete;
+  timer_wheel& operator=(const timer_wheel&) = delete;
+  void push(timer_node* node) noexcept override {
+    _place(node);
+    _size++;
+  }
+  void erase(timer_node* node) noexcept override {
+    _unlink(node);
+    _size--;
+  }
+  timer_node* pop(const std::chrono::steady_clock::time_point& now,
+                  std::size_t limit) noexcept override {
+    if (!_size) return nullptr;
+    _advance(now <= _origin ? 0
+                            : std::uint64_t((now - _origin) / _granularity));
+    timer_node* node = _bucket[_expired].head;
+    if (!node || node->seq >= limit) return nullptr;
+    erase(node);
+    return node;
+  }
+  std::chrono::steady_clock::time_point next() const noexcept override {
+    using rep = std::chrono::steady_clock::rep;
+    if (_bucket[_expired].head) return _origin + _granularity * rep(_tick);
+    return _origin + _granularity * rep(_next_tick());
+  }
+  bool empty() const noexcept override { return !_size; }
+};
+};  // namespace detail
+};  // namespace awacorn
+#endif
+#endif
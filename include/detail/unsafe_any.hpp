@@ -5,57 +5,171 @@
  * Project Awacorn 基于 MIT 协议开源。
  * Copyright(c) 凌 2022.
  */
+#include <cstddef>
+#include <cstring>
 #include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 namespace awacorn {
 namespace detail {
 /**
  * @brief 不进行类型检查的 any 容器。
+ *
+ * 不超过两个指针大小、且移动构造不抛出异常的对象 (如 int、指针、
+ * std::exception_ptr 和 promise) 直接存放在容器内部，其余的存放在堆上。
  */
 struct unsafe_any {
-  unsafe_any() = default;
+ private:
+  // 手写的虚表。各项为 nullptr 时使用按字节复制 / 无需析构 / 不允许拷贝。
+  struct _vtable {
+    /**
+     * @brief 对象是否存放在堆上 (内联存储中只保存指针)。
+     */
+    bool heap;
+    void (*move)(void* dst, void* src) noexcept;
+    void (*destroy)(void*) noexcept;
+    void (*copy)(void* dst, const void* src);
+  };
+  struct _storage {
+    alignas(void*) unsigned char data[2 * sizeof(void*)];
+  };
+  template <typename T>
+  struct _fits
+      : std::integral_constant<
+            bool, sizeof(T) <= sizeof(_storage) &&
+                      alignof(void*) % alignof(T) == 0 &&
+                      std::is_nothrow_move_constructible<T>::value> {};
+  template <typename T>
+  struct _inline {
+    static void move(void* dst, void* src) noexcept {
+      ::new (dst) T(std::move(*static_cast<T*>(src)));
+      static_cast<T*>(src)->~T();
+    }
+    static void destroy(void* p) noexcept { static_cast<T*>(p)->~T(); }
+    template <typename U = T>
+    static typename std::enable_if<std::is_copy_constructible<U>::value,
+                                   void (*)(void*, const void*)>::type
+    copier() noexcept {
+      return [](void* dst, const void* src) {
+        ::new (dst) T(*static_cast<const T*>(src));
+      };
+    }
+    template <typename U = T>
+    static typename std::enable_if<!std::is_copy_constructible<U>::value,
+                                   void (*)(void*, const void*)>::type
+    copier() noexcept {
+      return nullptr;
+    }
+    static inline const _vtable* vtable() noexcept {
+      static const _vtable vt = {
+          false, std::is_trivially_copyable<T>::value ? nullptr : move,
+          std::is_trivially_destructible<T>::value ? nullptr : destroy,
+          copier()};
+      return &vt;
+    }
+  };
+  template <typename T>
+  struct _heap {
+    static void destroy(void* p) noexcept { delete *static_cast<T**>(p); }
+    template <typename U = T>
+    static typename std::enable_if<std::is_copy_constructible<U>::value,
+                                   void (*)(void*, const void*)>::type
+    copier() noexcept {
+      return [](void* dst, const void* src) {
+        ::new (dst) T*(new T(**static_cast<T* const*>(src)));
+      };
+    }
+    template <typename U = T>
+    static typename std::enable_if<!std::is_copy_constructible<U>::value,
+                                   void (*)(void*, const void*)>::type
+    copier() noexcept {
+      return nullptr;
+    }
+    static inline const _vtable* vtable() noexcept {
+      static const _vtable vt = {true, nullptr, destroy, copier()};
+      return &vt;
+    }
+  };
+  inline void* _get() const noexcept {
+    void* p = const_cast<_storage*>(&_buf);
+    return _vt->heap ? *static_cast<void**>(p) : p;
+  }
+  inline void _reset() noexcept {
+    if (_vt) {
+      if (_vt->destroy) _vt->destroy(&_buf);
+      _vt = nullptr;
+    }
+  }
+  inline void _take(unsafe_any& v) noexcept {
+    if ((_vt = v._vt)) {
+      if (_vt->move)
+        _vt->move(&_buf, &v._buf);
+      else
+        std::memcpy(&_buf, &v._buf, sizeof(_storage));
+      v._vt = nullptr;
+    }
+  }
+  void _copy(const unsafe_any& v) {
+    if (!v._vt) return;
+    if (!v._vt->copy)
+      throw std::logic_error("unsafe_any: value is not copy constructible");
+    v._vt->copy(&_buf, &v._buf);
+    _vt = v._vt;
+  }
+  _storage _buf;
+  const _vtable* _vt;
+
+ public:
+  unsafe_any() noexcept : _vt(nullptr) {}
   /**
    * @brief 构造 any 对象。
    *
    * @tparam T 原对象的类型。
    * @param v 原对象。对象必须至少允许移动构造。
    */
-  template <typename T>
-  unsafe_any(T&& v)
-      : _ptr(new _derived<typename std::decay<T>::type>(std::forward<T>(v))) {}
-  unsafe_any(const unsafe_any& v) : _ptr(v._ptr ? v._ptr->clone() : nullptr) {}
-  unsafe_any(unsafe_any&& v) : _ptr(std::move(v._ptr)) {}
+  template <typename T, typename U = typename std::decay<T>::type,
+            typename std::enable_if<
+                !std::is_same<U, unsafe_any>::value && _fits<U>::value,
+                int>::type = 0>
+  unsafe_any(T&& v) : _vt(_inline<U>::vtable()) {
+    ::new (static_cast<void*>(&_buf)) U(std::forward<T>(v));
+  }
+  template <typename T, typename U = typename std::decay<T>::type,
+            typename std::enable_if<
+                !std::is_same<U, unsafe_any>::value && !_fits<U>::value,
+                long>::type = 0>
+  unsafe_any(T&& v) : _vt(_heap<U>::vtable()) {
+    ::new (static_cast<void*>(&_buf)) U*(new U(std::forward<T>(v)));
+  }
+  /**
+   * @brief 复制 any 对象。
+   *
+   * @exception std::logic_error 原对象不允许拷贝构造时抛出。
+   */
+  unsafe_any(const unsafe_any& v) : _vt(nullptr) { _copy(v); }
+  unsafe_any(unsafe_any&& v) noexcept : _vt(nullptr) { _take(v); }
   unsafe_any& operator=(const unsafe_any& v) {
-    _ptr = v._ptr ? v._ptr->clone() : nullptr;
+    if (this != &v) {
+      unsafe_any tmp(v);
+      _reset();
+      _take(tmp);
+    }
     return *this;
   }
-  unsafe_any& operator=(unsafe_any&& v) {
-    _ptr = std::move(v._ptr);
+  unsafe_any& operator=(unsafe_any&& v) noexcept {
+    if (this != &v) {
+      _reset();
+      _take(v);
+    }
     return *this;
   }
+  ~unsafe_any() { _reset(); }
   template <typename T>
   friend constexpr const T& unsafe_cast(const unsafe_any& v) noexcept;
   template <typename T>
   friend constexpr T&& unsafe_cast(unsafe_any&& v) noexcept;
-
- private:
-  struct _base {
-    virtual void* get() noexcept = 0;
-    virtual std::unique_ptr<_base> clone() const = 0;
-    virtual ~_base() {}
-  };
-  template <typename T>
-  struct _derived : _base {
-    void* get() noexcept override { return &data; }
-    std::unique_ptr<_base> clone() const override {
-      return std::unique_ptr<_base>(new _derived(data));
-    }
-    _derived(T&& v) : data(std::move(v)){};
-    _derived(const T& v) : data(v){};
-
-   private:
-    T data;
-  };
-  std::unique_ptr<_base> _ptr;
 };
 /**
  * @brief 类型不安全的 any 对象转换。
@@ -66,13 +180,13 @@ struct unsafe_any {
  */
 template <typename T>
 constexpr const T& unsafe_cast(const unsafe_any& v) noexcept {
-  return *((T*)v._ptr->get());
+  return *static_cast<const T*>(v._get());
 }
 template <typename T>
 constexpr T&& unsafe_cast(unsafe_any&& v) noexcept {
-  return std::move(*((T*)v._ptr->get()));
+  return std::move(*static_cast<T*>(v._get()));
 }
 };  // namespace detail
 };  // namespace awacorn
 #endif
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,334 @@
+#ifndef _AWACORN_URING_
+#define _AWACORN_URING_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#if defined(AWACORN_USE_IO_URING)
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <system_error>
+#include <vector>
+
+#include "function.hpp"
+namespace awacorn {
+namespace detail {
+/**
+ * @brief 不依赖 liburing 的 io_uring 封装。
+ *
+ * 提交的操作先写入提交队列，直到 submit() 或 wait() 时才以一次 io_uring_enter
+ * 批量提交。完成队列中的结果通过回调返回 (参数为 cqe 的 res)。
+ */
+class uring {
+  struct op {
+    function<void(int)> fn;
+    __kernel_timespec ts;
+  };
+  enum class state_t { unknown, ready, unsupported };
+
+  state_t _state;
+  int _fd;
+  void* _ring;
+  std::size_t _ring_size;
+  io_uring_sqe* _sqes;
+  std::size_t _sqes_size;
+  // 提交队列
+  unsigned* _sq_head;
+  unsigned* _sq_tail;
+  unsigned* _sq_mask;
+  unsigned* _sq_array;
+  unsigned _sq_entries;
+  // 完成队列
+  unsigned* _cq_head;
+  unsigned* _cq_tail;
+  unsigned* _cq_mask;
+  io_uring_cqe* _cqes;
+  // 已写入但尚未提交的 sqe 数量。
+  unsigned _queued;
+  // 尚未完成的操作数量 (不含内部的 poll 请求)。
+  std::size_t _inflight;
+  std::deque<op> _ops;
+  std::vector<op*> _free;
+  // 内部 poll 请求的 user_data 和完成标记。
+  static constexpr std::uint64_t _poll_tag = 1;
+  bool _poll_armed;
+  bool _poll_ready;
+
+  int _enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+             void* arg, std::size_t argsz) noexcept {
+    return int(syscall(__NR_io_uring_enter, _fd, to_submit, min_complete,
+                       flags, arg, argsz));
+  }
+  bool _init() noexcept {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CLAMP;
+    _fd = int(syscall(__NR_io_uring_setup, 256, &p));
+    if (_fd < 0) return false;
+    const unsigned required =
+        IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((p.features & required) != required) return false;
+    std::size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    std::size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    _ring_size = sq_size > cq_size ? sq_size : cq_size;
+    _ring = mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_ring == MAP_FAILED) {
+      _ring = nullptr;
+      return false;
+    }
+    _sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    _sqes = static_cast<io_uring_sqe*>(sqes);
+    char* ring = static_cast<char*>(_ring);
+    _sq_head = reinterpret_cast<unsigned*>(ring + p.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned*>(ring + p.sq_off.tail);
+    _sq_mask = reinterpret_cast<unsigned*>(ring + p.sq_off.ring_mask);
+    _sq_array = reinterpret_cast<unsigned*>(ring + p.sq_off.array);
+    _sq_entries = p.sq_entries;
+    _cq_head = reinterpret_cast<unsigned*>(ring + p.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned*>(ring + p.cq_off.tail);
+    _cq_mask = reinterpret_cast<unsigned*>(ring + p.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe*>(ring + p.cq_off.cqes);
+    return true;
+  }
+  void _reset() noexcept {
+    if (_sqes) munmap(_sqes, _sqes_size);
+    if (_ring) munmap(_ring, _ring_size);
+    if (_fd >= 0) close(_fd);
+    _sqes = nullptr;
+    _ring = nullptr;
+    _fd = -1;
+  }
+  // 提交排队的 sqe，不处理完成事件。
+  void _flush() {
+    _enter(_queued, 0, 0, nullptr, 0);
+    _queued = *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+  }
+  io_uring_sqe* _sqe() {
+    unsigned tail = *_sq_tail;
+    if (tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries) {
+      _flush();
+      if (tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries)
+        throw std::system_error(EBUSY, std::system_category());
+    }
+    io_uring_sqe* sqe = &_sqes[tail & *_sq_mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    _sq_array[tail & *_sq_mask] = tail & *_sq_mask;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    _queued++;
+    return sqe;
+  }
+  template <typename U>
+  io_uring_sqe* _prepare(std::uint8_t opcode, int fd, U&& fn) {
+    // 先取得 sqe：之后若抛出异常，清零的 sqe 只是一个被忽略的 NOP。
+    io_uring_sqe* sqe = _sqe();
+    function<void(int)> cb(std::forward<U>(fn));
+    op* o;
+    if (_free.empty()) {
+      _ops.emplace_back();
+      o = &_ops.back();
+    } else {
+      o = _free.back();
+      _free.pop_back();
+    }
+    o->fn = std::move(cb);
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = reinterpret_cast<std::uint64_t>(o);
+    _inflight++;
+    return sqe;
+  }
+  void _reap() {
+    for (;;) {
+      unsigned head = *_cq_head;
+      if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) return;
+      io_uring_cqe* cqe = &_cqes[head & *_cq_mask];
+      std::uint64_t data = cqe->user_data;
+      int res = cqe->res;
+      __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+      if (data == 0) continue;
+      if (data == _poll_tag) {
+        _poll_armed = false;
+        _poll_ready = true;
+        continue;
+      }
+      op* o = reinterpret_cast<op*>(data);
+      function<void(int)> fn = std::move(o->fn);
+      _free.push_back(o);
+      _inflight--;
+      fn(std::move(res));
+    }
+  }
+
+ public:
+  uring()
+      : _state(state_t::unknown),
+        _fd(-1),
+        _ring(nullptr),
+        _ring_size(0),
+        _sqes(nullptr),
+        _sqes_size(0),
+        _queued(0),
+        _inflight(0),
+        _poll_armed(false),
+        _poll_ready(false) {}
+  uring(const uring&) = delete;
+  uring& operator=(const uring&) = delete;
+  ~uring() { _reset(); }
+  /**
+   * @brief 是否可用。第一次调用时创建 io_uring，失败则之后都返回 false。
+   */
+  bool available() noexcept {
+    if (_state == state_t::unknown) {
+      if (_init()) {
+        _state = state_t::ready;
+      } else {
+        _reset();
+        _state = state_t::unsupported;
+      }
+    }
+    return _state == state_t::ready;
+  }
+  /**
+   * @brief 是否没有未完成的操作。
+   */
+  inline bool empty() const noexcept { return !_inflight; }
+  template <typename U>
+  void read(int fd, void* buf, std::size_t len, std::int64_t offset, U&& fn) {
+    io_uring_sqe* sqe = _prepare(IORING_OP_READ, fd, std::forward<U>(fn));
+    sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+    sqe->len = unsigned(len);
+    sqe->off = std::uint64_t(offset);
+  }
+  template <typename U>
+  void write(int fd, const void* buf, std::size_t len, std::int64_t offset,
+             U&& fn) {
+    io_uring_sqe* sqe = _prepare(IORING_OP_WRITE, fd, std::forward<U>(fn));
+    sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+    sqe->len = unsigned(len);
+    sqe->off = std::uint64_t(offset);
+  }
+  template <typename U>
+  void accept(int fd, void* addr, void* addrlen, int flags, U&& fn) {
+    io_uring_sqe* sqe = _prepare(IORING_OP_ACCEPT, fd, std::forward<U>(fn));
+    sqe->addr = reinterpret_cast<std::uint64_t>(addr);
+    sqe->addr2 = reinterpret_cast<std::uint64_t>(addrlen);
+    sqe->accept_flags = std::uint32_t(flags);
+  }
+  template <typename U>
+  void connect(int fd, const void* addr, std::size_t addrlen, U&& fn) {
+    io_uring_sqe* sqe = _prepare(IORING_OP_CONNECT, fd, std::forward<U>(fn));
+    sqe->addr = reinterpret_cast<std::uint64_t>(addr);
+    sqe->off = std::uint64_t(addrlen);
+  }
+  template <typename U>
+  void fsync(int fd, bool datasync, U&& fn) {
+    io_uring_sqe* sqe = _prepare(IORING_OP_FSYNC, fd, std::forward<U>(fn));
+    sqe->fsync_flags = datasync ? IORING_FSYNC_DATASYNC : 0;
+  }
+  template <typename U>
+  void timeout(const std::chrono::steady_clock::duration& tm, U&& fn) {
+    io_uring_sqe* sqe = _prepare(IORING_OP_TIMEOUT, -1, std::forward<U>(fn));
+    op* o = reinterpret_cast<op*>(sqe->user_data);
+    auto sec = std::chrono::duration_cast<std::chrono::seconds>(tm);
+    o->ts.tv_sec = sec.count();
+    o->ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        tm - sec)
+                        .count();
+    sqe->addr = reinterpret_cast<std::uint64_t>(&o->ts);
+    sqe->len = 1;
+  }
+  /**
+   * @brief 取消 fd 上所有未完成的操作 (需要 Linux 5.19 及以上)。
+   *
+   * @param fd 文件描述符。
+   */
+  void cancel(int fd) {
+#if defined(IORING_ASYNC_CANCEL_FD) && defined(IORING_ASYNC_CANCEL_ALL)
+    if (!_inflight) return;
+    io_uring_sqe* sqe = _sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+#else
+    (void)fd;
+#endif
+  }
+  /**
+   * @brief 在 fd 可读时结束下一次 wait()。用于等待 epoll 实例。
+   *
+   * @param fd 文件描述符。
+   */
+  void poll(int fd) {
+    if (_poll_armed) return;
+    io_uring_sqe* sqe = _sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = _poll_tag;
+    _poll_armed = true;
+  }
+  /**
+   * @brief 取出并清除 poll() 的完成标记。
+   */
+  inline bool polled() noexcept {
+    bool ready = _poll_ready;
+    _poll_ready = false;
+    return ready;
+  }
+  /**
+   * @brief 提交所有排队的操作，并处理已有的完成事件，不等待。
+   */
+  inline void submit() { wait(std::chrono::steady_clock::duration(0)); }
+  /**
+   * @brief 提交所有排队的操作，等待至少一个完成事件并分发。
+   *
+   * @param timeout 最长等待时间。负值表示无限等待，0 表示不等待。
+   */
+  void wait(const std::chrono::steady_clock::duration& timeout) {
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    unsigned min_complete = 0;
+    if (timeout != std::chrono::steady_clock::duration(0)) {
+      flags |= IORING_ENTER_GETEVENTS;
+      min_complete = 1;
+      if (timeout > std::chrono::steady_clock::duration(0)) {
+        auto sec = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        ts.tv_sec = sec.count();
+        ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         timeout - sec)
+                         .count();
+        arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+      }
+    }
+    int ret = _enter(_queued, min_complete, flags, &arg, sizeof(arg));
+    int err = errno;
+    _queued = *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if (ret < 0 && err != ETIME && err != EINTR && err != EBUSY &&
+        err != EAGAIN)
+      throw std::system_error(err, std::system_category());
+    _reap();
+  }
+};
+};  // namespace detail
+};  // namespace awacorn
+#endif
+#endif
+#endif
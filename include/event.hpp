@@ -5,12 +5,28 @@
  * Project Awacorn 基于 MIT 协议开源。
  * Copyright(c) 凌 2023.
  */
+#include <atomic>
 #include <chrono>
-#include <list>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
-#include "detail/capture.hpp"
 #include "detail/function.hpp"
+#include "detail/microtask.hpp"
+#include "detail/mpsc.hpp"
+#include "detail/pool.hpp"
+#include "detail/reactor.hpp"
+#include "detail/timer.hpp"
+#include "detail/uring.hpp"
+#if defined(AWACORN_USE_EPOLL)
+#include <sys/socket.h>
+
+#include "promise.hpp"
+#endif
 
 namespace awacorn {
 class event_loop;
@@ -18,7 +34,7 @@ class task_t {
   /**
    * @brief 事件的标识。
    */
-  class event {
+  class event : public detail::timer_node {
     /**
      * @brief 事件类型。
      */
@@ -31,30 +47,24 @@ class task_t {
      * @brief 对于 Interval 是循环间隔，对于 Event 无效。
      */
     std::chrono::steady_clock::duration timeout;
+    /**
+     * @brief 事件槽的代数，每次回收时自增，用于判断标识是否失效。
+     */
+    std::size_t gen;
     /**
      * @brief 用于指定一个事件是一次性事件还是循环事件。
      */
     bool interval;
 
    public:
-    template <typename U>
-    explicit event(U&& fn, const std::chrono::steady_clock::duration& timeout,
-                   bool interval)
-        : fn(std::forward<U>(fn)), timeout(timeout), interval(interval) {}
+    event() : timeout(0), gen(0), interval(false) {}
     event(const event&) = delete;
-    event(event&& v)
-        : fn(std::move(v.fn)), timeout(v.timeout), interval(v.interval) {}
     event& operator=(const event&) = delete;
-    event& operator=(event&& rhs) {
-      fn = std::move(rhs.fn);
-      timeout = rhs.timeout;
-      interval = rhs.interval;
-      return *this;
-    }
     friend class awacorn::event_loop;
   };
-  std::list<event>::const_iterator it;
-  task_t(std::list<event>::const_iterator it) : it(it) {}
+  event* ptr;
+  std::size_t gen;
+  task_t(event* ptr, std::size_t gen) : ptr(ptr), gen(gen) {}
 
  public:
   friend class event_loop;
@@ -69,69 +79,406 @@ inline void yield_for(const std::chrono::steady_clock::duration& tm) noexcept {
     std::this_thread::sleep_for(tm);
   }
 }
+/**
+ * @brief 分层时间轮配置。传入 event_loop
+ * 的构造函数以使用时间轮存储定时事件。
+ */
+struct timing_wheel {
+  /**
+   * @brief 每个 tick 的长度。事件最多会延后一个 tick 触发。
+   */
+  std::chrono::steady_clock::duration granularity;
+  template <typename Rep = std::chrono::milliseconds::rep,
+            typename Period = std::chrono::milliseconds::period>
+  explicit timing_wheel(const std::chrono::duration<Rep, Period>& granularity =
+                            std::chrono::milliseconds(1))
+      : granularity(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                granularity)) {}
+};
 /**
  * @brief 事件循环。
  */
 class event_loop {
-  std::list<task_t::event> _event;
-  std::list<task_t::event>::iterator _current;
+  /**
+   * @brief 事件回调的存储。须先于 _pool 构造、晚于 _pool 析构。
+   */
+  detail::pool _alloc;
+  /**
+   * @brief 循环运行时安装到线程上的 frame_pool，缓存 promise
+   * 的状态、回调记录和协程帧等短期对象，随循环析构归还给系统。
+   */
+  detail::frame_pool _arena;
+  /**
+   * @brief 事件存储。deque 保证元素地址稳定，回收的事件槽由 _free 复用。
+   */
+  std::deque<task_t::event> _pool;
+  std::vector<task_t::event*> _free;
+  std::unique_ptr<detail::timer_queue> _timer;
+  task_t::event* _current;
+  std::size_t _seq;
+  /**
+   * @brief yield 实现。为空时使用可被 post 唤醒的默认实现。
+   */
   detail::function<void(const std::chrono::steady_clock::duration&)> _yield;
-  bool _execute() {
-    if (!_event.empty()) {
-      auto min = _event.cend();
-      for (auto it = _event.cbegin();
-           it != _event.cend(); it++) {
-        if (min == _event.cend() || it->timeout < min->timeout) min = it;
+  /**
+   * @brief promise 回调的 microtask 队列。为空时回调同步执行。
+   */
+  std::unique_ptr<detail::microtask_queue> _microtask;
+  /**
+   * @brief set_microtask 设定的状态。循环运行时不替换 _microtask
+   * (它已安装到线程上)，等 start 返回后再应用。
+   */
+  bool _use_microtask = false;
+  /**
+   * @brief 嵌套运行 start 的层数。
+   */
+  std::size_t _running = 0;
+  /**
+   * @brief 其它线程通过 post 提交的函数。
+   */
+  detail::mpsc_queue<detail::function<void()>> _posted;
+  /**
+   * @brief 循环线程的睡眠状态。post 以原子交换取走它，只有取到睡眠状态的
+   * 线程负责唤醒。
+   */
+  static constexpr int _awake = 0;
+  static constexpr int _sleep_cond = 1;
+  static constexpr int _sleep_fd = 2;
+  std::atomic<int> _sleep{_awake};
+  std::atomic<std::size_t> _ref{0};
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  bool _signaled = false;
+#if defined(AWACORN_USE_EPOLL)
+  detail::reactor _reactor;
+  detail::notifier _notifier;
+  bool _attached = false;
+#if defined(AWACORN_USE_IO_URING)
+  detail::uring _uring;
+#endif
+  /**
+   * @brief 将 eventfd 加入 epoll 实例，使 post 可以打断 I/O 等待。
+   */
+  inline void _attach() {
+    if (_attached) return;
+    _reactor.attach(_notifier.fd());
+    _attached = true;
+  }
+#endif
+  /**
+   * @brief 进入睡眠状态。之后提交的函数会唤醒循环线程。
+   *
+   * @return false 已有提交的函数，不应睡眠。
+   */
+  inline bool _sleep_on(int mode) noexcept {
+    _sleep.store(mode);
+    if (_posted.empty()) return true;
+    _sleep.store(_awake);
+    return false;
+  }
+  /**
+   * @brief 唤醒正在睡眠的循环线程。线程安全。
+   */
+  inline void _notify() {
+    switch (_sleep.exchange(_awake)) {
+      case _sleep_cond: {
+        // 持有锁时通知，避免循环线程醒来并析构事件循环后才访问 _cond。
+        std::lock_guard<std::mutex> lock(_mutex);
+        _signaled = true;
+        _cond.notify_one();
+        break;
       }
-      auto tm =
-          std::chrono::steady_clock::now();
-      if (min->timeout > std::chrono::steady_clock::duration(0))
-        _yield(min->timeout);
-      auto duration =
-          std::chrono::steady_clock::now() - tm;
-      for (auto it = _event.begin();
-           it != _event.end(); it++) {
-        it->timeout = it->timeout > duration
-                          ? (it->timeout - duration)
-                          : std::chrono::steady_clock::duration(0);
+#if defined(AWACORN_USE_EPOLL)
+      case _sleep_fd:
+        _notifier.notify();
+        break;
+#endif
+    }
+  }
+  /**
+   * @brief 空闲等待。有 I/O 等待者时由 io_uring 或 reactor 等待，否则调用
+   * yield 实现。
+   *
+   * @param tm 预期可用时间。为 0 时表示循环内没有定时事件。
+   */
+  inline void _wait(const std::chrono::steady_clock::duration& tm) {
+#if defined(AWACORN_USE_EPOLL)
+    const std::chrono::steady_clock::duration io_tm =
+        tm == std::chrono::steady_clock::duration(0)
+            ? std::chrono::steady_clock::duration(-1)
+            : tm;
+#endif
+#if defined(AWACORN_USE_IO_URING)
+    if (!_uring.empty()) {
+      // 通过 io_uring 同时等待 epoll 实例，一次系统调用即可完成提交和等待。
+      _attach();
+      _uring.poll(_reactor.fd());
+      if (_sleep_on(_sleep_fd)) {
+        _uring.wait(io_tm);
+        if (_sleep.exchange(_awake) == _awake) _notifier.clear();
+      } else {
+        _uring.submit();
       }
-      tm = std::chrono::steady_clock::now();
-      for (auto it = _event.begin();
-           it != _event.end();) {
-        if (it->timeout == std::chrono::steady_clock::duration(0)) {
-          _current = it;
-          it->fn();
-          if (!it->interval) {
-            it = _event.erase(it);
-            continue;
-          }
-        }
-        it++;
+      if (_uring.polled())
+        _reactor.wait(std::chrono::steady_clock::duration(0));
+      return;
+    }
+#endif
+#if defined(AWACORN_USE_EPOLL)
+    if (!_reactor.empty()) {
+      _attach();
+      if (_sleep_on(_sleep_fd)) {
+        _reactor.wait(io_tm);
+        if (_sleep.exchange(_awake) == _awake) _notifier.clear();
+      } else {
+        _reactor.wait(std::chrono::steady_clock::duration(0));
+      }
+      return;
+    }
+#endif
+    if (_yield) return _yield(tm);
+    if (!_sleep_on(_sleep_cond)) return;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      auto signaled = [this]() { return _signaled; };
+      if (tm != std::chrono::steady_clock::duration(0))
+        _cond.wait_for(lock, tm, signaled);
+      else if (_ref.load())
+        _cond.wait(lock, signaled);
+      _signaled = false;
+    }
+    _sleep.store(_awake);
+  }
+  /**
+   * @brief 执行其它线程提交的函数。
+   */
+  inline void _run_posted() {
+    detail::function<void()> fn;
+    while (_posted.pop(fn)) {
+      fn();
+      _flush();
+    }
+  }
+  /**
+   * @brief 按 _use_microtask 创建或释放 microtask 队列。
+   */
+  inline void _apply_microtask() {
+    if (!_use_microtask)
+      _microtask.reset();
+    else if (!_microtask)
+      _microtask.reset(new detail::microtask_queue());
+  }
+  /**
+   * @brief start 期间的运行标记，最外层的 start 返回时应用延后的
+   * set_microtask。
+   */
+  class _run_scope {
+    event_loop* _ev;
+
+   public:
+    explicit _run_scope(event_loop* ev) noexcept : _ev(ev) { _ev->_running++; }
+    _run_scope(const _run_scope&) = delete;
+    _run_scope& operator=(const _run_scope&) = delete;
+    ~_run_scope() {
+      if (!--_ev->_running) _ev->_apply_microtask();
+    }
+  };
+  /**
+   * @brief 执行当前回调产生的 microtask。
+   */
+  inline void _flush() {
+    if (_microtask) _microtask->run();
+  }
+  /**
+   * @brief 循环内是否还有未完成的工作。
+   */
+  inline bool _alive() const noexcept {
+    if (_ref.load() || !_posted.empty()) return true;
+#if defined(AWACORN_USE_IO_URING)
+    if (!_uring.empty()) return true;
+#endif
+#if defined(AWACORN_USE_EPOLL)
+    if (!_reactor.empty()) return true;
+#endif
+    return !_timer->empty();
+  }
+  /**
+   * @brief 不等待地提交并处理 I/O。
+   */
+  inline void _poll_io() {
+#if defined(AWACORN_USE_IO_URING)
+    if (!_uring.empty()) _uring.submit();
+#endif
+#if defined(AWACORN_USE_EPOLL)
+    if (!_reactor.empty())
+      _reactor.wait(std::chrono::steady_clock::duration(0));
+#endif
+  }
+  bool _execute() {
+    if (!_timer->empty()) {
+      auto now = std::chrono::steady_clock::now();
+      auto deadline = _timer->next();
+      if (deadline > now) {
+        _wait(deadline - now);
+        now = std::chrono::steady_clock::now();
+      } else {
+        // 有事件到期时也检查一次 I/O，避免 I/O 被定时事件饿死。
+        _poll_io();
       }
-      duration = std::chrono::steady_clock::now() - tm;
-      for (auto it = _event.begin();
-           it != _event.end(); it++) {
-        it->timeout = it->timeout > duration
-                          ? (it->timeout - duration)
-                          : std::chrono::steady_clock::duration(0);
+      _flush();
+      _run_posted();
+      // 本轮中新注册 (或重新计时) 的事件留到下一轮，避免 0 间隔事件饿死循环。
+      const std::size_t limit = _seq;
+      while (detail::timer_node* node = _timer->pop(now, limit)) {
+        auto ev = static_cast<task_t::event*>(node);
+        _current = ev;
+        try {
+          ev->fn();
+        } catch (...) {
+          _current = nullptr;
+          _settle(ev, now);
+          throw;
+        }
+        _current = nullptr;
+        _settle(ev, now);
+        _flush();
       }
       return true;
     }
-    _yield(std::chrono::steady_clock::duration(0));
-    return !_event.empty();
+    _wait(std::chrono::steady_clock::duration(0));
+    _flush();
+    _run_posted();
+    return _alive();
+  }
+  /**
+   * @brief 事件触发后，重新计时循环事件或回收一次性事件。
+   */
+  inline void _settle(task_t::event* ev,
+                      const std::chrono::steady_clock::time_point& now) {
+    if (ev->interval) {
+      ev->deadline = now + ev->timeout;
+      ev->seq = _seq++;
+      _timer->push(ev);
+    } else {
+      _release(ev);
+    }
+  }
+  inline void _release(task_t::event* ev) {
+    ev->fn = nullptr;
+    ev->gen++;
+    _free.push_back(ev);
+  }
+  template <typename U>
+  task_t _create(U&& fn, const std::chrono::steady_clock::duration& timeout,
+                 bool interval) {
+    task_t::event* ev;
+    if (_free.empty()) {
+      _pool.emplace_back();
+      ev = &_pool.back();
+    } else {
+      ev = _free.back();
+      _free.pop_back();
+    }
+    ev->fn = task_t::event::fn_t(std::allocator_arg,
+                                 detail::pool_allocator<char>(&_alloc),
+                                 std::forward<U>(fn));
+    ev->timeout = timeout;
+    ev->interval = interval;
+    ev->deadline = std::chrono::steady_clock::now() + timeout;
+    ev->seq = _seq++;
+    _timer->push(ev);
+    return task_t(ev, ev->gen);
+  }
+#if defined(AWACORN_USE_EPOLL)
+  /**
+   * @brief I/O 回调：非负结果 resolve，负的 errno 以 std::system_error 拒绝。
+   */
+  struct _result_cb {
+    promise<int> pm;
+    void operator()(int res) const {
+      if (res < 0)
+        pm.reject(std::make_exception_ptr(
+            std::system_error(-res, std::system_category())));
+      else
+        pm.resolve(res);
+    }
+  };
+  template <typename U, typename T>
+  inline void _watch(int fd, std::uint32_t events, U&& fn,
+                     const promise<T>& pm) {
+    try {
+      _reactor.watch(fd, events, std::forward<U>(fn));
+    } catch (...) {
+      pm.reject(std::current_exception());
+    }
   }
-  template <typename... Args>
-  static inline task_t _create(std::list<task_t::event>* list, Args&&... args) {
-    return list->emplace_back(std::forward<Args>(args)...),
-           task_t(--list->cend());
+  inline promise<void> _ready(int fd, std::uint32_t events) {
+    promise<void> pm;
+    _watch(
+        fd, events,
+        [pm](int revents) {
+          if (revents < 0)
+            pm.reject(std::make_exception_ptr(
+                std::system_error(-revents, std::system_category())));
+          else
+            pm.resolve();
+        },
+        pm);
+    return pm;
   }
+  /**
+   * @brief 非阻塞地尝试操作，遇到 EAGAIN 时等待 fd 就绪后重试。
+   */
+  template <typename Op>
+  void _attempt(int fd, std::uint32_t events, const Op& op,
+                const promise<int>& pm) {
+    for (;;) {
+      auto ret = op();
+      if (ret >= 0) return pm.resolve(int(ret));
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return _result_cb{pm}(-errno);
+      break;
+    }
+    _watch(
+        fd, events,
+        [this, fd, events, op, pm](int revents) {
+          if (revents < 0)
+            _result_cb{pm}(revents);
+          else
+            _attempt(fd, events, op, pm);
+        },
+        pm);
+  }
+#if defined(AWACORN_USE_IO_URING)
+  /**
+   * @brief 若 io_uring 可用，则通过它提交操作。
+   *
+   * @return true 已通过 io_uring 提交 (或提交失败并拒绝了 pm)。
+   * @return false io_uring 不可用，需要回退到 epoll。
+   */
+  template <typename U>
+  inline bool _submit(const promise<int>& pm, U&& fn) {
+    if (!_uring.available()) return false;
+    try {
+      fn();
+    } catch (...) {
+      pm.reject(std::current_exception());
+    }
+    return true;
+  }
+#endif
+#endif
 
  public:
   /**
    * @brief 设置 yield 实现。
    *
    * @tparam U 新 yield 实现的类型。
-   * @param impl yield 实现的对象，可以为仿函数对象或者函数指针。
+   * @param impl yield 实现的对象，可以为仿函数对象或者函数指针。传入 nullptr
+   * 时恢复默认实现。
+   * @note 自定义的 yield 实现不会被 post 打断。
    */
   template <typename U>
   inline void set_yield(U&& impl) noexcept {
@@ -144,7 +491,9 @@ class event_loop {
    * @return task_t
    * 当前正在执行的事件。若没有，返回 nullptr。
    */
-  inline task_t current() const noexcept { return task_t(_current); }
+  inline task_t current() const noexcept {
+    return task_t(_current, _current ? _current->gen : 0);
+  }
   /**
    * @brief 创建定时事件。
    *
@@ -155,7 +504,7 @@ class event_loop {
   template <typename Rep, typename Period, typename U>
   inline task_t event(U&& fn, const std::chrono::duration<Rep, Period>& tm) {
     return _create(
-        &_event, std::forward<U>(fn),
+        std::forward<U>(fn),
         std::chrono::duration_cast<std::chrono::steady_clock::duration>(tm),
         false);
   }
@@ -168,38 +517,321 @@ class event_loop {
    */
   template <typename Rep, typename Period, typename U>
   inline task_t interval(U&& fn, const std::chrono::duration<Rep, Period>& tm) {
-    auto arg_fn = detail::capture(std::forward<U>(fn));
     return _create(
-        &_event,
-        [this, arg_fn, tm]() mutable {
-          arg_fn.borrow()();
-          _current->timeout = tm;
-        },
+        std::forward<U>(fn),
         std::chrono::duration_cast<std::chrono::steady_clock::duration>(tm),
         true);
   }
   /**
-   * @brief 删除即将发生的事件。
+   * @brief 删除即将发生的事件。已触发或已删除的事件将被忽略。
    *
    * @param task 事件标识。
    */
   void clear(task_t task) {
-    if (task.it == _event.cend()) return;
-    if (task.it == _current)
-      _current->interval = false;
-    else
-      _event.erase(task.it);
+    task_t::event* ev = task.ptr;
+    if (!ev || ev->gen != task.gen) return;
+    if (ev == _current) {
+      ev->interval = false;
+    } else {
+      _timer->erase(ev);
+      _release(ev);
+    }
+  }
+#if defined(AWACORN_USE_EPOLL)
+  /**
+   * @brief 等待文件描述符就绪。
+   *
+   * @param fd 文件描述符。
+   * @param events 关注的事件，如 EPOLLIN、EPOLLOUT。
+   * @return promise<int> 就绪的事件 (可能包含 EPOLLERR、EPOLLHUP)。注册失败或被
+   * cancel 时以 std::system_error 拒绝。
+   */
+  inline promise<int> poll(int fd, int events) {
+    promise<int> pm;
+    _watch(fd, std::uint32_t(events), _result_cb{pm}, pm);
+    return pm;
   }
+  /**
+   * @brief 等待文件描述符可读 (或出错)。
+   *
+   * @param fd 文件描述符。
+   * @return promise<void> 可读时完成的 promise。
+   */
+  inline promise<void> readable(int fd) { return _ready(fd, EPOLLIN); }
+  /**
+   * @brief 等待文件描述符可写 (或出错)。
+   *
+   * @param fd 文件描述符。
+   * @return promise<void> 可写时完成的 promise。
+   */
+  inline promise<void> writable(int fd) { return _ready(fd, EPOLLOUT); }
+  /**
+   * @brief 取消文件描述符上所有的等待。关闭 fd 前应调用此函数。
+   *
+   * @param fd 文件描述符。
+   */
+  inline void cancel(int fd) {
+#if defined(AWACORN_USE_IO_URING)
+    _uring.cancel(fd);
+#endif
+    _reactor.cancel(fd);
+  }
+  /**
+   * @brief 异步读取。
+   *
+   * 以下 I/O 操作在定义了 AWACORN_USE_IO_URING 且内核支持时通过 io_uring
+   * 批量提交，否则回退到 epoll (需要非阻塞的 fd)。操作完成前 buf、addr
+   * 等参数必须保持有效。
+   *
+   * @param fd 文件描述符。
+   * @param buf 缓冲区。
+   * @param len 缓冲区长度。
+   * @param offset 读取的位置，-1 表示使用文件当前位置。
+   * @return promise<int> 读取的字节数。失败时以 std::system_error 拒绝。
+   */
+  promise<int> read(int fd, void* buf, std::size_t len,
+                    std::int64_t offset = -1) {
+    promise<int> pm;
+#if defined(AWACORN_USE_IO_URING)
+    if (_submit(pm, [&]() {
+          _uring.read(fd, buf, len, offset, _result_cb{pm});
+        }))
+      return pm;
+#endif
+    _attempt(
+        fd, EPOLLIN,
+        [fd, buf, len, offset]() {
+          return offset < 0 ? ::read(fd, buf, len)
+                            : ::pread(fd, buf, len, off_t(offset));
+        },
+        pm);
+    return pm;
+  }
+  /**
+   * @brief 异步写入。
+   *
+   * @param fd 文件描述符。
+   * @param buf 缓冲区。
+   * @param len 写入的长度。
+   * @param offset 写入的位置，-1 表示使用文件当前位置。
+   * @return promise<int> 写入的字节数。失败时以 std::system_error 拒绝。
+   */
+  promise<int> write(int fd, const void* buf, std::size_t len,
+                     std::int64_t offset = -1) {
+    promise<int> pm;
+#if defined(AWACORN_USE_IO_URING)
+    if (_submit(pm,
+                [&]() { _uring.write(fd, buf, len, offset, _result_cb{pm}); }))
+      return pm;
+#endif
+    _attempt(
+        fd, EPOLLOUT,
+        [fd, buf, len, offset]() {
+          return offset < 0 ? ::write(fd, buf, len)
+                            : ::pwrite(fd, buf, len, off_t(offset));
+        },
+        pm);
+    return pm;
+  }
+  /**
+   * @brief 异步接受连接。
+   *
+   * @param fd 监听的 socket。
+   * @param addr 可选，对端地址。
+   * @param addrlen 可选，对端地址的长度。
+   * @param flags accept4 的标志，如 SOCK_NONBLOCK。
+   * @return promise<int> 新连接的 fd。失败时以 std::system_error 拒绝。
+   */
+  promise<int> accept(int fd, sockaddr* addr = nullptr,
+                      socklen_t* addrlen = nullptr, int flags = 0) {
+    promise<int> pm;
+#if defined(AWACORN_USE_IO_URING)
+    if (_submit(pm, [&]() {
+          _uring.accept(fd, addr, addrlen, flags, _result_cb{pm});
+        }))
+      return pm;
+#endif
+    _attempt(
+        fd, EPOLLIN,
+        [fd, addr, addrlen, flags]() {
+          return ::accept4(fd, addr, addrlen, flags);
+        },
+        pm);
+    return pm;
+  }
+  /**
+   * @brief 异步连接。
+   *
+   * @param fd socket。
+   * @param addr 目标地址。
+   * @param addrlen 目标地址的长度。
+   * @return promise<int> 成功时为 0。失败时以 std::system_error 拒绝。
+   */
+  promise<int> connect(int fd, const sockaddr* addr, socklen_t addrlen) {
+    promise<int> pm;
+#if defined(AWACORN_USE_IO_URING)
+    if (_submit(pm, [&]() {
+          _uring.connect(fd, addr, addrlen, _result_cb{pm});
+        }))
+      return pm;
+#endif
+    if (::connect(fd, addr, addrlen) == 0) {
+      pm.resolve(0);
+    } else if (errno != EINPROGRESS) {
+      _result_cb{pm}(-errno);
+    } else {
+      _watch(
+          fd, EPOLLOUT,
+          [fd, pm](int revents) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (revents >= 0 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+              err = errno;
+            _result_cb{pm}(revents < 0 ? revents : -err);
+          },
+          pm);
+    }
+    return pm;
+  }
+  /**
+   * @brief 异步同步文件数据到磁盘。回退到 epoll 时为同步调用。
+   *
+   * @param fd 文件描述符。
+   * @param datasync 是否只同步数据 (fdatasync)。
+   * @return promise<int> 成功时为 0。失败时以 std::system_error 拒绝。
+   */
+  promise<int> fsync(int fd, bool datasync = false) {
+    promise<int> pm;
+#if defined(AWACORN_USE_IO_URING)
+    if (_submit(pm, [&]() { _uring.fsync(fd, datasync, _result_cb{pm}); }))
+      return pm;
+#endif
+    _result_cb{pm}((datasync ? ::fdatasync(fd) : ::fsync(fd)) == 0 ? 0
+                                                                 : -errno);
+    return pm;
+  }
+  /**
+   * @brief 经过指定时间后完成。
+   *
+   * @param tm 等待的时间。
+   * @return promise<int> 完成时为 0。
+   */
+  template <typename Rep, typename Period>
+  promise<int> timeout(const std::chrono::duration<Rep, Period>& tm) {
+    promise<int> pm;
+    auto dur =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(tm);
+#if defined(AWACORN_USE_IO_URING)
+    if (_submit(pm, [&]() {
+          _uring.timeout(dur, [pm](int res) {
+            _result_cb{pm}(res == -ETIME ? 0 : res);
+          });
+        }))
+      return pm;
+#endif
+    event([pm]() { pm.resolve(0); }, dur);
+    return pm;
+  }
+#endif
+  /**
+   * @brief 在事件循环所在的线程执行 fn。线程安全，可以在任意线程调用。
+   *
+   * 事件循环正在空闲等待 (默认 yield 实现、epoll 或 io_uring) 时会被立刻唤醒。
+   * 提交的函数按提交顺序执行。
+   *
+   * @param fn 要执行的函数。
+   */
+  template <typename U>
+  void post(U&& fn) {
+    _posted.push(detail::function<void()>(std::forward<U>(fn)));
+    _notify();
+  }
+  /**
+   * @brief 增加引用计数。线程安全。
+   *
+   * 引用计数不为 0 时，即使循环内没有事件，事件循环也不会退出，而是等待
+   * post。用于等待其它线程的结果。
+   */
+  inline void ref() noexcept { _ref++; }
+  /**
+   * @brief 减少引用计数。线程安全。
+   */
+  inline void unref() {
+    if (_ref.fetch_sub(1) == 1) _notify();
+  }
+  /**
+   * @brief 启用或关闭 microtask 队列。
+   *
+   * 启用后，在事件循环中 resolve / reject 的 promise
+   * 不会立刻调用回调，而是在当前回调 (定时事件、post 或 I/O)
+   * 返回后依次执行，因此回调链和 await 循环不会让调用栈增长。
+   *
+   * 在循环运行时 (回调中) 调用，启用或关闭都在 start 返回后才生效：
+   * 本次运行仍按原来的方式执行回调，已加入队列的回调照常执行。
+   *
+   * @param enable 是否启用。
+   */
+  inline void set_microtask(bool enable) {
+    _use_microtask = enable;
+    if (!_running) _apply_microtask();
+  }
+  /**
+   * @brief 设置循环缓存的每个大小级别最多保留的块数，超出的块直接释放。
+   *
+   * 循环运行时，其回调中创建的 promise 状态、回调记录、gather
+   * 的计数和协程帧都从循环的缓存申请，释放后留在缓存中复用，
+   * 不经过 malloc。设为 0 则不缓存。
+   *
+   * 请在循环线程上或循环未运行时调用。
+   *
+   * @param limit 每个级别最多保留的块数，默认为 256。
+   */
+  inline void set_arena_limit(std::size_t limit) noexcept {
+    _arena.set_limit(limit);
+  }
+  /**
+   * @brief 释放循环缓存的所有块。
+   */
+  inline void trim_arena() noexcept { _arena.trim(); }
   /**
    * @brief 运行事件循环。此函数将在所有事件都运行完成之后返回。
    */
   inline void start() {
+    detail::frame_pool::scope arena(&_arena);
+    _run_scope running(this);
+    detail::microtask_queue::scope scope(_microtask.get());
+    _flush();
     while (_execute())
       ;
   }
-  event_loop() : _yield(yield_for) {}
+  event_loop()
+      : _timer(new detail::timer_heap()),
+        _current(nullptr),
+        _seq(0) {}
+  template <typename U,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<U>::type, timing_wheel>::value>::type>
+  event_loop(U&& yield_impl)
+      : _timer(new detail::timer_heap()),
+        _current(nullptr),
+        _seq(0),
+        _yield(std::forward<U>(yield_impl)) {}
+  /**
+   * @brief 构造使用分层时间轮的事件循环。
+   *
+   * @param wheel 时间轮配置。
+   */
+  explicit event_loop(const timing_wheel& wheel)
+      : _timer(new detail::timer_wheel(wheel.granularity)),
+        _current(nullptr),
+        _seq(0) {}
   template <typename U>
-  event_loop(U&& yield_impl) : _yield(std::forward<U>(yield_impl)) {}
+  event_loop(U&& yield_impl, const timing_wheel& wheel)
+      : _timer(new detail::timer_wheel(wheel.granularity)),
+        _current(nullptr),
+        _seq(0),
+        _yield(std::forward<U>(yield_impl)) {}
   event_loop(const event_loop&) = delete;
   event_loop& operator=(const event_loop&) = delete;
 };
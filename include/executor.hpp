@@ -0,0 +1,389 @@
+#ifndef _AWACORN_EXECUTOR_
+#define _AWACORN_EXECUTOR_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "async.hpp"
+#include "detail/capture.hpp"
+#include "detail/function.hpp"
+#include "event.hpp"
+#include "promise.hpp"
+namespace awacorn {
+/**
+ * @brief 多线程执行器。每个工作线程运行一个 event_loop，并拥有一个可被窃取的
+ * 任务队列。
+ *
+ * 定时事件和 fd 仍然绑定在注册它们的 event_loop 上；通过 post / spawn /
+ * schedule 提交的任务则可以在任意工作线程执行，空闲的线程会从繁忙的线程
+ * 窃取任务。
+ */
+class executor {
+  struct worker {
+    executor* owner;
+    std::size_t index;
+    event_loop loop;
+    /**
+     * @brief 任务队列。所有者从尾部取出，窃取者从头部取走一半。
+     */
+    std::mutex mutex;
+    std::deque<detail::function<void()>> tasks;
+    /**
+     * @brief 是否已向 loop 提交了 _run。
+     */
+    std::atomic<bool> scheduled;
+    /**
+     * @brief 上一次 _run 是否因为没有任务而结束。
+     */
+    std::atomic<bool> idle;
+    /**
+     * @brief 是否正在 _run 中。只由所属线程访问。
+     */
+    bool running;
+    worker(executor* owner, std::size_t index)
+        : owner(owner),
+          index(index),
+          scheduled(false),
+          idle(true),
+          running(false) {}
+  };
+  /**
+   * @brief 每次 _run 最多执行的任务数，之后让出给 event_loop
+   * 处理定时事件和 I/O。
+   */
+  static constexpr std::size_t _budget = 64;
+  std::vector<std::unique_ptr<worker>> _workers;
+  std::atomic<std::size_t> _next;
+  std::atomic<std::size_t> _idle;
+  std::mutex _mutex;
+  std::exception_ptr _error;
+  bool _running;
+
+  static inline worker*& _tls() noexcept {
+    static thread_local worker* w = nullptr;
+    return w;
+  }
+  inline worker* _self() const noexcept {
+    worker* w = _tls();
+    return w && w->owner == this ? w : nullptr;
+  }
+  inline worker& _origin() const {
+    worker* w = _self();
+    if (!w)
+      throw std::logic_error("Must be called from a thread of the executor.");
+    return *w;
+  }
+  bool _pop(worker& w, detail::function<void()>& fn) {
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (w.tasks.empty()) return false;
+    fn = std::move(w.tasks.back());
+    w.tasks.pop_back();
+    return true;
+  }
+  bool _steal(worker& self, detail::function<void()>& fn) {
+    const std::size_t n = _workers.size();
+    for (std::size_t i = 1; i < n; i++) {
+      worker& victim = *_workers[(self.index + i) % n];
+      std::deque<detail::function<void()>> batch;
+      {
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        // 取走较早提交的一半，减少反复窃取。
+        for (std::size_t k = (victim.tasks.size() + 1) / 2; k > 0; k--) {
+          batch.push_back(std::move(victim.tasks.front()));
+          victim.tasks.pop_front();
+        }
+      }
+      if (batch.empty()) continue;
+      fn = std::move(batch.front());
+      batch.pop_front();
+      if (!batch.empty()) {
+        std::lock_guard<std::mutex> lock(self.mutex);
+        for (auto&& task : batch) self.tasks.push_front(std::move(task));
+      }
+      return true;
+    }
+    return false;
+  }
+  void _wake(worker& w) {
+    if (!w.scheduled.exchange(true)) w.loop.post([this, &w]() { _run(w); });
+  }
+  void _run(worker& w) {
+    w.scheduled.store(false);
+    if (w.idle.exchange(false)) _idle--;
+    w.running = true;
+    detail::function<void()> fn;
+    for (std::size_t i = 0; i < _budget; i++) {
+      if (!_pop(w, fn) && !_steal(w, fn)) {
+        w.running = false;
+        if (!w.idle.exchange(true)) _idle++;
+        return;
+      }
+      try {
+        fn();
+      } catch (...) {
+        w.running = false;
+        throw;
+      }
+      fn = nullptr;
+    }
+    w.running = false;
+    _wake(w);
+  }
+  void _submit(detail::function<void()>&& fn) {
+    worker* self = _self();
+    worker& w = self ? *self : *_workers[_next++ % _workers.size()];
+    {
+      std::lock_guard<std::mutex> lock(w.mutex);
+      w.tasks.push_back(std::move(fn));
+    }
+    // 正在 _run 中时，任务会在本轮被取出，无需再次唤醒。
+    if (!w.running || &w != self) _wake(w);
+    if (!_idle.load()) return;
+    for (auto&& v : _workers) {
+      if (v.get() != &w && v->idle.exchange(false)) {
+        _idle--;
+        _wake(*v);
+        return;
+      }
+    }
+  }
+  void _main(worker& w) {
+    _tls() = &w;
+    try {
+      w.loop.start();
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_error) _error = std::current_exception();
+      }
+      stop();
+    }
+    _tls() = nullptr;
+  }
+  /**
+   * @brief 恢复由 async 创建的协程，直到它结束或在 await 中切出。
+   */
+  static void _drive(context& ctx) {
+    for (;;) {
+      ctx._step(ctx._arg);
+      if (ctx._status != detail::async_state_t::Awaiting) return;
+      int state = context::_running;
+      // 切出之后才允许唤醒方把协程交给其它线程。
+      if (ctx._wake_state.compare_exchange_strong(state, context::_parked))
+        return;
+      // 切出的过程中 promise 已经完成。
+      ctx._wake_state.store(context::_running);
+    }
+  }
+  /**
+   * @brief 协程 await 的 promise 完成时，在完成它的线程上调用。协程重新进入
+   * 任务队列，可以被任意工作线程窃取。
+   */
+  static void _dispatch(context* ctx) {
+    executor* self = static_cast<executor*>(ctx->_dispatcher);
+    std::shared_ptr<void> owner = ctx->_owner.lock();
+    self->post([owner, ctx]() { _drive(*ctx); });
+  }
+  template <typename Ret>
+  struct _forward {
+    static void apply(event_loop* origin, const promise<Ret>& from,
+                      const promise<Ret>& to) {
+      detail::promise_access::subscribe(
+          from,
+          [origin, to](Ret&& value) {
+            auto ret = detail::capture(std::move(value));
+            origin->post(
+                [to, ret]() mutable { to.resolve(std::move(ret.borrow())); });
+          },
+          [origin, to](std::exception_ptr&& err) {
+            std::exception_ptr e = std::move(err);
+            origin->post([to, e]() { to.reject(e); });
+          });
+    }
+  };
+  template <typename Ret>
+  struct _deliver {
+    template <typename U>
+    static void apply(event_loop* origin, const promise<Ret>& pm, U& fn) {
+      auto ret = detail::capture(fn());
+      origin->post(
+          [pm, ret]() mutable { pm.resolve(std::move(ret.borrow())); });
+    }
+  };
+
+ public:
+  /**
+   * @brief 构造执行器。
+   *
+   * @param n 工作线程数量。为 0 时使用 std::thread::hardware_concurrency()。
+   */
+  explicit executor(std::size_t n = 0) : _next(0), _idle(0), _running(false) {
+    if (!n) n = std::thread::hardware_concurrency();
+    if (!n) n = 1;
+    _idle = n;
+    for (std::size_t i = 0; i < n; i++)
+      _workers.emplace_back(new worker(this, i));
+  }
+  executor(const executor&) = delete;
+  executor& operator=(const executor&) = delete;
+  /**
+   * @brief 工作线程数量。
+   */
+  inline std::size_t size() const noexcept { return _workers.size(); }
+  /**
+   * @brief 第 i 个工作线程的事件循环。在其上注册的定时事件和 fd
+   * 只会在该线程上触发。
+   *
+   * @param i 工作线程的编号。
+   * @return event_loop& 事件循环。
+   */
+  inline event_loop& loop(std::size_t i) noexcept { return _workers[i]->loop; }
+  /**
+   * @brief 调用线程所属的事件循环。
+   *
+   * @return event_loop* 事件循环。调用线程不是任何执行器的工作线程时返回
+   * nullptr。
+   */
+  static inline event_loop* current() noexcept {
+    worker* w = _tls();
+    return w ? &w->loop : nullptr;
+  }
+  /**
+   * @brief 提交可被窃取的任务。线程安全，可以在任意线程调用。
+   *
+   * @param fn 任务。
+   */
+  template <typename U>
+  void post(U&& fn) {
+    _submit(detail::function<void()>(std::forward<U>(fn)));
+  }
+  /**
+   * @brief 提交可被窃取的任务，并在调用线程的事件循环上取得结果。
+   * 只能在工作线程调用。
+   *
+   * @param fn 任务。
+   * @return promise<decltype(fn())> 任务的结果。
+   * @exception std::logic_error 调用线程不是工作线程时抛出。
+   */
+  template <typename U>
+  auto spawn(U&& fn) -> promise<decltype(fn())> {
+    using Ret = decltype(fn());
+    event_loop* origin = &_origin().loop;
+    promise<Ret> pm(thread_safe);
+    auto arg_fn = detail::capture(std::forward<U>(fn));
+    post([origin, pm, arg_fn]() mutable {
+      try {
+        _deliver<Ret>::apply(origin, pm, arg_fn.borrow());
+      } catch (...) {
+        std::exception_ptr err = std::current_exception();
+        origin->post([pm, err]() { pm.reject(err); });
+      }
+    });
+    return pm;
+  }
+  /**
+   * @brief 在执行器上运行有栈协程，结果交回调用线程的事件循环。只能在工作
+   * 线程调用。
+   *
+   * 协程首先作为可被窃取的任务提交；此后每当它 await 的 promise 完成，
+   * 协程都会重新进入完成该 promise 的线程的任务队列，因此可以在任意工作
+   * 线程上恢复。
+   *
+   * @param fn 函数。
+   * @param stack_size 可选，栈的大小(字节, 如果可用)。
+   * @return promise<decltype(fn(std::declval<context&>()))> 协程的结果。
+   * @exception std::logic_error 调用线程不是工作线程时抛出。
+   */
+  template <typename U>
+  auto async(U&& fn, std::size_t stack_size = 0)
+      -> promise<decltype(fn(std::declval<context&>()))> {
+    using Ret = decltype(fn(std::declval<context&>()));
+    event_loop* origin = &_origin().loop;
+    std::shared_ptr<detail::async_fn<Ret>> co =
+        detail::async_fn<Ret>::create(std::forward<U>(fn), stack_size);
+    co->ctx._dispatch = _dispatch;
+    co->ctx._dispatcher = this;
+    promise<Ret> pm(thread_safe);
+    _forward<Ret>::apply(origin, co->_pm, pm);
+    post([co]() { _drive(co->ctx); });
+    return pm;
+  }
+  /**
+   * @brief 让出当前的工作线程。返回的 promise 会在任意一个工作线程上完成，
+   * 因此 await 它的协程可以被其它线程窃取。只能在工作线程调用。
+   *
+   * @return promise<void> 在某个工作线程上完成的 promise。
+   * @exception std::logic_error 调用线程不是工作线程时抛出。
+   */
+  promise<void> schedule() {
+    event_loop& origin = _origin().loop;
+    promise<void> pm(thread_safe);
+    // 等到当前回调返回 (调用方已注册回调) 后才让任务可被窃取。
+    origin.post([this, pm]() { post([pm]() { pm.resolve(); }); });
+    return pm;
+  }
+  /**
+   * @brief 运行所有工作线程，调用线程作为第 0 个工作线程。此函数在 stop
+   * 被调用、且各事件循环都运行完成之后返回。
+   *
+   * @exception 任一工作线程抛出的第一个异常。
+   */
+  void start() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _running = true;
+      _error = nullptr;
+    }
+    for (auto&& w : _workers) w->loop.ref();
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < _workers.size(); i++)
+      threads.emplace_back([this, i]() { _main(*_workers[i]); });
+    _main(*_workers[0]);
+    for (auto&& t : threads) t.join();
+    if (_error) std::rethrow_exception(_error);
+  }
+  /**
+   * @brief 允许工作线程在没有工作时退出。线程安全。
+   *
+   * @note 之后提交到已退出线程的任务不会被执行。
+   */
+  void stop() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_running) return;
+    _running = false;
+    for (auto&& w : _workers) w->loop.unref();
+  }
+};
+template <>
+struct executor::_forward<void> {
+  static void apply(event_loop* origin, const promise<void>& from,
+                    const promise<void>& to) {
+    detail::promise_access::subscribe(
+        from, [origin, to]() { origin->post([to]() { to.resolve(); }); },
+        [origin, to](std::exception_ptr&& err) {
+          std::exception_ptr e = std::move(err);
+          origin->post([to, e]() { to.reject(e); });
+        });
+  }
+};
+template <>
+struct executor::_deliver<void> {
+  template <typename U>
+  static void apply(event_loop* origin, const promise<void>& pm, U& fn) {
+    fn();
+    origin->post([pm]() { pm.resolve(); });
+  }
+};
+};  // namespace awacorn
+#endif
+#endif
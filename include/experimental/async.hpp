@@ -591,14 +591,25 @@ class basic_fn {
   template <typename U>
   inline static expr<U> await(const expr<promise<U>>& v) {
     return expr<U>([v](context<T>& ctx) {
-      return v.apply(ctx).then([](promise<U>&& v) {
+      promise<promise<U>> pm = v.apply(ctx);
+      // 表达式已同步求值时直接返回其结果，不再经过 then。
+      variant<promise<U>, std::exception_ptr> slot;
+      if (detail::promise_access::take(pm, slot))
+        return slot.index() == 0 ? std::move(get<0>(slot))
+                                 : reject<U>(std::move(get<1>(slot)));
+      return pm.then([](promise<U>&& v) {
         return v;
       });  // 这里返回了一个 promise<U> 所以最终的类型是 expr<U>
     });
   }
   inline static expr<void> await(const expr<promise<void>>& v) {
     return expr<void>([v](context<T>& ctx) {
-      return v.apply(ctx).then([](promise<void>&& v) { return v; });
+      promise<promise<void>> pm = v.apply(ctx);
+      variant<promise<void>, std::exception_ptr> slot;
+      if (detail::promise_access::take(pm, slot))
+        return slot.index() == 0 ? std::move(get<0>(slot))
+                                 : reject<void>(std::move(get<1>(slot)));
+      return pm.then([](promise<void>&& v) { return v; });
     });
   }
   inline static expr<void> error(const expr<std::exception_ptr>& v) {
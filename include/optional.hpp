@@ -0,0 +1,129 @@
+#ifndef _AWACORN_OPTIONAL_
+#define _AWACORN_OPTIONAL_
+#if __cplusplus >= 201101L
+/**
+ * Project Awacorn 基于 MIT 协议开源。
+ * Copyright(c) 凌 2023.
+ */
+#if __cplusplus >= 201703L
+#include <optional>
+#else
+#include <exception>
+#include <new>
+#include <utility>
+#endif
+namespace awacorn {
+#if __cplusplus >= 201703L
+/**
+ * @brief 等同于 std::optional。
+ *
+ * @tparam T 值类型。
+ */
+template <typename T>
+using optional = std::optional<T>;
+/**
+ * @brief 等同于 std::nullopt_t。
+ */
+using nullopt_t = std::nullopt_t;
+/**
+ * @brief 等同于 std::nullopt。
+ */
+inline constexpr nullopt_t nullopt = std::nullopt;
+/**
+ * @brief 等同于 std::bad_optional_access。
+ */
+using bad_optional_access = std::bad_optional_access;
+#else
+/**
+ * @brief 表示空的 optional。
+ */
+struct nullopt_t {
+  explicit constexpr nullopt_t(int) noexcept {}
+};
+constexpr nullopt_t nullopt{0};
+/**
+ * @brief 访问空的 optional 时抛出。
+ */
+struct bad_optional_access : std::exception {
+  const char* what() const noexcept override { return "bad optional access"; }
+};
+/**
+ * @brief std::optional 的简单实现，只提供 Awacorn 用到的部分。
+ *
+ * @tparam T 值类型。
+ */
+template <typename T>
+class optional {
+  union {
+    char _dummy;
+    T _val;
+  };
+  bool _has;
+
+ public:
+  optional() noexcept : _dummy(), _has(false) {}
+  optional(nullopt_t) noexcept : _dummy(), _has(false) {}
+  optional(const T& val) : _val(val), _has(true) {}
+  optional(T&& val) : _val(std::move(val)), _has(true) {}
+  optional(const optional& rhs) : _dummy(), _has(false) {
+    if (rhs._has) emplace(rhs._val);
+  }
+  optional(optional&& rhs) : _dummy(), _has(false) {
+    if (rhs._has) emplace(std::move(rhs._val));
+  }
+  optional& operator=(const optional& rhs) {
+    if (this != &rhs) {
+      reset();
+      if (rhs._has) emplace(rhs._val);
+    }
+    return *this;
+  }
+  optional& operator=(optional&& rhs) {
+    if (this != &rhs) {
+      reset();
+      if (rhs._has) emplace(std::move(rhs._val));
+    }
+    return *this;
+  }
+  optional& operator=(nullopt_t) noexcept {
+    reset();
+    return *this;
+  }
+  ~optional() { reset(); }
+  template <typename... Args>
+  T& emplace(Args&&... args) {
+    reset();
+    new (&_val) T(std::forward<Args>(args)...);
+    _has = true;
+    return _val;
+  }
+  void reset() noexcept {
+    if (_has) {
+      _val.~T();
+      _has = false;
+    }
+  }
+  bool has_value() const noexcept { return _has; }
+  explicit operator bool() const noexcept { return _has; }
+  T& operator*() & { return _val; }
+  const T& operator*() const& { return _val; }
+  T&& operator*() && { return std::move(_val); }
+  T* operator->() { return &_val; }
+  const T* operator->() const { return &_val; }
+  T& value() & {
+    if (!_has) throw bad_optional_access();
+    return _val;
+  }
+  const T& value() const& {
+    if (!_has) throw bad_optional_access();
+    return _val;
+  }
+  T&& value() && {
+    if (!_has) throw bad_optional_access();
+    return std::move(_val);
+  }
+};
+#endif
+};  // namespace awacorn
+#endif
+#endif
@@ -8,10 +8,15 @@
 #include <array>
 #include <exception>
 #include <memory>
+#include <stdexcept>
 #include <tuple>
+#include <type_traits>
 
 #include "detail/capture.hpp"
 #include "detail/function.hpp"
+#include "detail/microtask.hpp"
+#include "detail/pool.hpp"
+#include "detail/ref.hpp"
 #include "variant.hpp"
 namespace awacorn {
 /**
@@ -23,6 +28,406 @@ enum status_t {
   rejected = 2    // 已失败。
 };
 namespace detail {
+struct promise_access;
+/**
+ * @brief 表示没有对应回调的占位类型，见 promise_state::subscribe。
+ */
+struct no_callback {};
+/**
+ * @brief promise 的回调记录。then / error / finally
+ * 注册的回调连同其闭包保存在同一次分配中，记录之间以单链表相连。
+ *
+ * @tparam Slot 结果的存储类型。
+ */
+template <typename Slot>
+struct continuation {
+  // 记录处理的结果。
+  enum : unsigned char {
+    on_fulfilled = 1,  // 完成时调用，取走结果。
+    on_rejected = 2,   // 失败时调用，取走错误。
+    on_settled = 4     // 无论结果如何都调用 (finally)。
+  };
+  continuation* next;
+  unsigned char roles;
+  /**
+   * @brief 以结果调用记录，然后销毁记录并归还内存。slot 为 nullptr
+   * 时只销毁。
+   */
+  void (*run)(continuation* self, status_t status, Slot* slot);
+};
+/**
+ * @brief 以存储的结果调用回调。
+ */
+template <typename Slot>
+struct slot_invoke {
+  template <typename U>
+  static inline void fulfill(U& fn, Slot& slot) {
+    fn(std::move(get<0>(slot)));
+  }
+  template <typename U>
+  static inline void reject(U& fn, Slot& slot) {
+    fn(std::move(get<1>(slot)));
+  }
+};
+template <>
+struct slot_invoke<std::exception_ptr> {
+  template <typename U>
+  static inline void fulfill(U& fn, std::exception_ptr&) {
+    fn();
+  }
+  template <typename U>
+  static inline void reject(U& fn, std::exception_ptr& slot) {
+    fn(std::move(slot));
+  }
+};
+/**
+ * @brief 以存储的结果调用回调，但不取走结果：值以 const
+ * 引用传递，错误传递副本。用于 shared_promise。
+ */
+template <typename Slot>
+struct shared_invoke {
+  template <typename U>
+  static inline void fulfill(U& fn, Slot& slot) {
+    const auto& value = get<0>(slot);
+    fn(value);
+  }
+  template <typename U>
+  static inline void reject(U& fn, Slot& slot) {
+    fn(std::exception_ptr(get<1>(slot)));
+  }
+};
+template <>
+struct shared_invoke<std::exception_ptr> {
+  template <typename U>
+  static inline void fulfill(U& fn, std::exception_ptr&) {
+    fn();
+  }
+  template <typename U>
+  static inline void reject(U& fn, std::exception_ptr& slot) {
+    fn(std::exception_ptr(slot));
+  }
+};
+template <typename Slot, typename OnFulfilled, typename OnRejected,
+          typename OnSettled, typename Invoke = slot_invoke<Slot>>
+class continuation_node : continuation<Slot> {
+  using base = continuation<Slot>;
+  template <typename U>
+  using has =
+      std::integral_constant<bool, !std::is_same<U, no_callback>::value>;
+  OnFulfilled _on_fulfilled;
+  OnRejected _on_rejected;
+  OnSettled _on_settled;
+
+  inline void _fulfill(Slot& slot, std::true_type) {
+    Invoke::fulfill(_on_fulfilled, slot);
+  }
+  inline void _fulfill(Slot&, std::false_type) noexcept {}
+  inline void _reject(Slot& slot, std::true_type) {
+    Invoke::reject(_on_rejected, slot);
+  }
+  inline void _reject(Slot&, std::false_type) noexcept {}
+  inline void _settle(std::true_type) { _on_settled(); }
+  inline void _settle(std::false_type) noexcept {}
+  static void _run(base* ptr, status_t status, Slot* slot) {
+    continuation_node* self = static_cast<continuation_node*>(ptr);
+    if (!slot) return _destroy(self);
+    // 先把回调移出并归还记录，回调中注册的下一条记录可以复用这块内存。
+    continuation_node local(std::move(*self));
+    _destroy(self);
+    if (status == fulfilled)
+      local._fulfill(*slot, has<OnFulfilled>());
+    else if (status == rejected)
+      local._reject(*slot, has<OnRejected>());
+    local._settle(has<OnSettled>());
+  }
+  static inline void _destroy(continuation_node* self) noexcept {
+    self->~continuation_node();
+    frame_allocator<continuation_node>().deallocate(self, 1);
+  }
+  template <typename U, typename V, typename W>
+  continuation_node(U&& on_fulfilled, V&& on_rejected, W&& on_settled)
+      : _on_fulfilled(std::forward<U>(on_fulfilled)),
+        _on_rejected(std::forward<V>(on_rejected)),
+        _on_settled(std::forward<W>(on_settled)) {
+    this->next = nullptr;
+    this->roles = (has<OnFulfilled>::value ? base::on_fulfilled : 0) |
+                  (has<OnRejected>::value ? base::on_rejected : 0) |
+                  (has<OnSettled>::value ? base::on_settled : 0);
+    this->run = &_run;
+  }
+
+ public:
+  /**
+   * @brief 创建回调记录。记录从当前线程的 frame_pool (在事件循环中为循环的
+   * 缓存) 申请，稳定状态下不调用 malloc。
+   *
+   * @return continuation<Slot>* 记录，由 run 销毁。
+   */
+  template <typename U, typename V, typename W>
+  static base* create(U&& on_fulfilled, V&& on_rejected, W&& on_settled) {
+    continuation_node* mem = frame_allocator<continuation_node>().allocate(1);
+    try {
+      return ::new (static_cast<void*>(mem))
+          continuation_node(std::forward<U>(on_fulfilled),
+                            std::forward<V>(on_rejected),
+                            std::forward<W>(on_settled));
+    } catch (...) {
+      frame_allocator<continuation_node>().deallocate(mem, 1);
+      throw;
+    }
+  }
+};
+/**
+ * @brief promise 的共享状态：结果与回调记录链表。
+ *
+ * 每个结果 (完成的值或失败的错误) 只能被一个回调取走，roles
+ * 记录已经被认领的结果；finally 回调不取走结果。完成时先调用 then / error
+ * 回调，再调用 finally 回调。
+ *
+ * @tparam Slot 结果的存储类型。
+ */
+template <typename Slot>
+class promise_state : public ref_base {
+  using node = continuation<Slot>;
+  status_t _status;
+  unsigned char _roles;
+  node* _head;
+
+  static void _destroy(node* list) noexcept {
+    while (list) {
+      node* c = list;
+      list = c->next;
+      c->run(c, pending, nullptr);
+    }
+  }
+  void _invoke(node*& list) {
+    while (list) {
+      node* c = list;
+      list = c->next;
+      c->run(c, _status, &val);
+    }
+  }
+  void _run(node* list) {
+    node* consumers = nullptr;
+    node* settled = nullptr;
+    node** consumers_tail = &consumers;
+    node** settled_tail = &settled;
+    while (list) {
+      node* c = list;
+      list = c->next;
+      c->next = nullptr;
+      node**& tail =
+          (c->roles & node::on_settled) ? settled_tail : consumers_tail;
+      *tail = c;
+      tail = &c->next;
+    }
+    try {
+      _invoke(consumers);
+      _invoke(settled);
+    } catch (...) {
+      _destroy(consumers);
+      _destroy(settled);
+      throw;
+    }
+  }
+  void _attach(node* c) {
+    unsigned char claim = c->roles & (node::on_fulfilled | node::on_rejected);
+    if (_status == fulfilled)
+      claim &= node::on_fulfilled;
+    else if (_status == rejected)
+      claim &= node::on_rejected;
+    if ((claim & _roles) ||
+        (_status == pending && (c->roles & _roles & node::on_settled))) {
+      _destroy(c);
+      throw std::logic_error(
+          "Registered callback but the result has been already moved.");
+    }
+    _roles |= claim | (c->roles & node::on_settled);
+    node** tail = &_head;
+    while (*tail) tail = &(*tail)->next;
+    *tail = c;
+    if (_status != pending) _fire();
+  }
+
+ protected:
+  Slot val;
+  /**
+   * @brief 取走所有回调记录并调用。当前线程安装了 microtask
+   * 队列时推迟到当前回调之后，见 detail::microtask_queue。
+   */
+  void _fire() {
+    if (!_head) return;
+    node* list = _head;
+    _head = nullptr;
+    retain();
+    ref_ptr<promise_state> self(this);
+    defer([self, list]() { self->_run(list); });
+  }
+  inline void _settle(status_t status) {
+    _status = status;
+    _fire();
+  }
+
+ public:
+  promise_state() noexcept
+      : _status(pending), _roles(0), _head(nullptr), val() {}
+  ~promise_state() {
+    _destroy(_head);
+    if (_status == rejected && !(_roles & node::on_rejected)) {
+      // Aborted due to unhandled rejection
+      std::abort();
+    }
+  }
+  /**
+   * @brief 注册一条回调记录。对应的结果已被其它回调认领时抛出
+   * std::logic_error；已完成时立即 (或在 microtask 中) 调用。
+   *
+   * @param on_fulfilled 完成时调用的函数，或 no_callback。
+   * @param on_rejected 失败时调用的函数，或 no_callback。
+   * @param on_settled 无论结果如何都调用的函数，或 no_callback。
+   */
+  template <typename U, typename V, typename W>
+  inline void subscribe(U&& on_fulfilled, V&& on_rejected, W&& on_settled) {
+    _attach(continuation_node<Slot, typename std::decay<U>::type,
+                              typename std::decay<V>::type,
+                              typename std::decay<W>::type>::
+                create(std::forward<U>(on_fulfilled),
+                       std::forward<V>(on_rejected),
+                       std::forward<W>(on_settled)));
+  }
+  template <typename U, typename V>
+  inline void subscribe(U&& on_fulfilled, V&& on_rejected) {
+    subscribe(std::forward<U>(on_fulfilled), std::forward<V>(on_rejected),
+              no_callback());
+  }
+  template <typename U>
+  inline void then(U&& fn) {
+    subscribe(std::forward<U>(fn), no_callback(), no_callback());
+  }
+  template <typename U>
+  inline void error(U&& fn) {
+    subscribe(no_callback(), std::forward<U>(fn), no_callback());
+  }
+  template <typename U>
+  inline void finally(U&& fn) {
+    subscribe(no_callback(), no_callback(), std::forward<U>(fn));
+  }
+  /**
+   * @brief 已完成且结果尚未被认领时直接取走结果，不注册回调。
+   *
+   * @param out 用于接收结果或异常。
+   * @return true 取得了结果。
+   * @return false 尚未完成，或结果已被认领。
+   */
+  bool take(Slot& out) {
+    unsigned char role =
+        _status == fulfilled ? node::on_fulfilled : node::on_rejected;
+    if (_status == pending || (_roles & role)) return false;
+    _roles |= role;
+    out = std::move(val);
+    return true;
+  }
+  inline constexpr status_t status() const noexcept { return _status; }
+};
+/**
+ * @brief shared_promise 的共享状态：结果与回调记录链表。
+ *
+ * 与 promise_state 不同，结果不会被取走，所有回调按注册顺序调用，
+ * 完成之后注册的回调也能取得结果。
+ *
+ * @tparam Slot 结果的存储类型。
+ */
+template <typename Slot>
+class shared_state : public ref_base {
+  using node = continuation<Slot>;
+  status_t _status;
+  node* _head;
+  node** _tail;
+
+  static void _destroy(node* list) noexcept {
+    while (list) {
+      node* c = list;
+      list = c->next;
+      c->run(c, pending, nullptr);
+    }
+  }
+  void _run(node* list) {
+    try {
+      while (list) {
+        node* c = list;
+        list = c->next;
+        c->run(c, _status, &val);
+      }
+    } catch (...) {
+      _destroy(list);
+      throw;
+    }
+  }
+
+ protected:
+  Slot val;
+  /**
+   * @brief 取走所有回调记录并调用，见 promise_state::_fire。
+   */
+  void _fire() {
+    if (!_head) return;
+    node* list = _head;
+    _head = nullptr;
+    _tail = &_head;
+    retain();
+    ref_ptr<shared_state> self(this);
+    defer([self, list]() { self->_run(list); });
+  }
+  inline void _settle(status_t status) {
+    _status = status;
+    _fire();
+  }
+
+ public:
+  shared_state() noexcept
+      : _status(pending), _head(nullptr), _tail(&_head), val() {}
+  ~shared_state() { _destroy(_head); }
+  /**
+   * @brief 在链表末尾追加一条回调记录。已完成时立即 (或在 microtask
+   * 中) 调用。
+   *
+   * @param on_fulfilled 完成时以结果的 const 引用调用的函数，或
+   * no_callback。
+   * @param on_rejected 失败时以错误的副本调用的函数，或 no_callback。
+   * @param on_settled 无论结果如何都调用的函数，或 no_callback。
+   */
+  template <typename U, typename V, typename W>
+  void subscribe(U&& on_fulfilled, V&& on_rejected, W&& on_settled) {
+    node* c = continuation_node<
+        Slot, typename std::decay<U>::type, typename std::decay<V>::type,
+        typename std::decay<W>::type,
+        shared_invoke<Slot>>::create(std::forward<U>(on_fulfilled),
+                                     std::forward<V>(on_rejected),
+                                     std::forward<W>(on_settled));
+    *_tail = c;
+    _tail = &c->next;
+    if (_status != pending) _fire();
+  }
+  template <typename U, typename V>
+  inline void subscribe(U&& on_fulfilled, V&& on_rejected) {
+    subscribe(std::forward<U>(on_fulfilled), std::forward<V>(on_rejected),
+              no_callback());
+  }
+  template <typename U>
+  inline void then(U&& fn) {
+    subscribe(std::forward<U>(fn), no_callback(), no_callback());
+  }
+  template <typename U>
+  inline void error(U&& fn) {
+    subscribe(no_callback(), std::forward<U>(fn), no_callback());
+  }
+  template <typename U>
+  inline void finally(U&& fn) {
+    subscribe(no_callback(), no_callback(), std::forward<U>(fn));
+  }
+  inline Slot& result() noexcept { return val; }
+  inline constexpr status_t status() const noexcept { return _status; }
+};
 struct basic_promise {
  protected:
   // Promise<T>.then(detail::function<Promise<Ret>(ArgType)>)
@@ -32,20 +437,24 @@ struct basic_promise {
             template <typename T> class PromiseT, typename _promise>
   struct _then_sub_impl {
     template <typename U>
-    static PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<Ret> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
-      pm->then([t, arg_fn](ArgType&& val) mutable {
-        try {
-          auto tmp = arg_fn.borrow()(std::move(val));
-          tmp.then([t](Ret&& val) { t.resolve(std::move(std::move(val))); });
-          tmp.error(
-              [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
-        } catch (...) {
-          t.reject(std::current_exception());
-        }
-      });
-      pm->error([t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+      pm->subscribe(
+          [t, arg_fn](ArgType&& val) mutable {
+            try {
+              auto tmp = arg_fn.borrow()(std::move(val));
+              // then 已经转发了 tmp 的错误，所以在它返回的 promise 上注册
+              // error。
+              tmp.then([t](Ret&& val) { t.resolve(std::move(val)); })
+                  .error([t](std::exception_ptr&& err) {
+                    t.reject(std::move(err));
+                  });
+            } catch (...) {
+              t.reject(std::current_exception());
+            }
+          },
+          [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
       return t;
     }
   };
@@ -54,20 +463,21 @@ struct basic_promise {
             typename _promise>
   struct _then_sub_impl<void, ArgType, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<void> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<void> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<void> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
-      pm->then([t, arg_fn](ArgType&& val) mutable {
-        try {
-          auto tmp = arg_fn.borrow()(std::move(val));
-          tmp.then([t]() { t.resolve(); });
-          tmp.error(
-              [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
-        } catch (...) {
-          t.reject(std::current_exception());
-        }
-      });
-      pm->error([t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+      pm->subscribe(
+          [t, arg_fn](ArgType&& val) mutable {
+            try {
+              auto tmp = arg_fn.borrow()(std::move(val));
+              tmp.then([t]() { t.resolve(); });
+              tmp.error(
+                  [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+            } catch (...) {
+              t.reject(std::current_exception());
+            }
+          },
+          [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
       return t;
     }
   };
@@ -77,20 +487,22 @@ struct basic_promise {
             typename _promise>
   struct _then_sub_impl<Ret, void, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<Ret> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
-      pm->then([t, arg_fn]() mutable {
-        try {
-          auto tmp = arg_fn.borrow()();
-          tmp.then([t](Ret&& val) { t.resolve(std::move(val)); });
-          tmp.error(
-              [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
-        } catch (...) {
-          t.reject(std::current_exception());
-        }
-      });
-      pm->error([t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+      pm->subscribe(
+          [t, arg_fn]() mutable {
+            try {
+              auto tmp = arg_fn.borrow()();
+              tmp.then([t](Ret&& val) { t.resolve(std::move(val)); })
+                  .error([t](std::exception_ptr&& err) {
+                    t.reject(std::move(err));
+                  });
+            } catch (...) {
+              t.reject(std::current_exception());
+            }
+          },
+          [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
       return t;
     }
   };
@@ -98,20 +510,21 @@ struct basic_promise {
   template <template <typename T> class PromiseT, typename _promise>
   struct _then_sub_impl<void, void, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<void> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<void> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<void> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
-      pm->then([t, arg_fn]() mutable {
-        try {
-          auto tmp = arg_fn.borrow()();
-          tmp.then([t]() { t.resolve(); });
-          tmp.error(
-              [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
-        } catch (...) {
-          t.reject(std::current_exception());
-        }
-      });
-      pm->error([t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+      pm->subscribe(
+          [t, arg_fn]() mutable {
+            try {
+              auto tmp = arg_fn.borrow()();
+              tmp.then([t]() { t.resolve(); });
+              tmp.error(
+                  [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+            } catch (...) {
+              t.reject(std::current_exception());
+            }
+          },
+          [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
       return t;
     }
   };
@@ -122,17 +535,18 @@ struct basic_promise {
             template <typename T> class PromiseT, typename _promise>
   struct _then_impl {
     template <typename U>
-    static PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<Ret> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
-      pm->then([t, arg_fn](ArgType&& val) mutable {
-        try {
-          t.resolve(arg_fn.borrow()(std::move(val)));
-        } catch (...) {
-          t.reject(std::current_exception());
-        }
-      });
-      pm->error([t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+      pm->subscribe(
+          [t, arg_fn](ArgType&& val) mutable {
+            try {
+              t.resolve(arg_fn.borrow()(std::move(val)));
+            } catch (...) {
+              t.reject(std::current_exception());
+            }
+          },
+          [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
       return t;
     }
   };
@@ -141,7 +555,7 @@ struct basic_promise {
             template <typename T> class PromiseT, typename _promise>
   struct _then_impl<PromiseT<Ret>, ArgType, PromiseT, _promise> {
     template <typename U>
-    static inline PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm,
+    static inline PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm,
                                       U&& fn) {
       return _then_sub_impl<Ret, ArgType, PromiseT, _promise>::apply(
           pm, std::forward<U>(fn));
@@ -152,18 +566,19 @@ struct basic_promise {
             typename _promise>
   struct _then_impl<void, ArgType, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<void> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<void> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<void> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
-      pm->then([t, arg_fn](ArgType&& val) mutable {
-        try {
-          arg_fn.borrow()(std::move(val));
-          t.resolve();
-        } catch (...) {
-          t.reject(std::current_exception());
-        }
-      });
-      pm->error([t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+      pm->subscribe(
+          [t, arg_fn](ArgType&& val) mutable {
+            try {
+              arg_fn.borrow()(std::move(val));
+              t.resolve();
+            } catch (...) {
+              t.reject(std::current_exception());
+            }
+          },
+          [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
       return t;
     }
   };
@@ -174,17 +589,18 @@ struct basic_promise {
             typename _promise>
   struct _then_impl<Ret, void, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<Ret> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
-      pm->then([t, arg_fn]() mutable {
-        try {
-          t.resolve(arg_fn.borrow()());
-        } catch (...) {
-          t.reject(std::current_exception());
-        }
-      });
-      pm->error([t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+      pm->subscribe(
+          [t, arg_fn]() mutable {
+            try {
+              t.resolve(arg_fn.borrow()());
+            } catch (...) {
+              t.reject(std::current_exception());
+            }
+          },
+          [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
       return t;
     }
   };
@@ -193,7 +609,7 @@ struct basic_promise {
             typename _promise>
   struct _then_impl<PromiseT<Ret>, void, PromiseT, _promise> {
     template <typename U>
-    static inline PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm,
+    static inline PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm,
                                       U&& fn) {
       return _then_sub_impl<Ret, void, PromiseT, _promise>::apply(
           pm, std::forward<U>(fn));
@@ -203,7 +619,7 @@ struct basic_promise {
   template <template <typename T> class PromiseT, typename _promise>
   struct _then_impl<void, void, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<void> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<void> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<void> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
       pm->then([t, arg_fn]() mutable {
@@ -228,15 +644,16 @@ struct basic_promise {
             typename _promise>
   struct _error_sub_impl {
     template <typename U>
-    static PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<Ret> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
       pm->error([t, arg_fn](std::exception_ptr&& val) mutable {
         try {
           auto tmp = arg_fn.borrow()(std::move(val));
-          tmp.then([t](Ret&& val) { t.resolve(std::move(val)); });
-          tmp.error(
-              [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+          tmp.then([t](Ret&& val) { t.resolve(std::move(val)); })
+              .error([t](std::exception_ptr&& err) {
+                t.reject(std::move(err));
+              });
         } catch (...) {
           t.reject(std::current_exception());
         }
@@ -249,7 +666,7 @@ struct basic_promise {
   template <template <typename T> class PromiseT, typename _promise>
   struct _error_sub_impl<void, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<void> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<void> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<void> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
       pm->error([t, arg_fn](std::exception_ptr&& val) mutable {
@@ -272,7 +689,7 @@ struct basic_promise {
             typename _promise>
   struct _error_impl {
     template <typename U>
-    static PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<Ret> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
       pm->error([t, arg_fn](std::exception_ptr&& err) mutable {
@@ -290,7 +707,7 @@ struct basic_promise {
             typename _promise>
   struct _error_impl<PromiseT<Ret>, PromiseT, _promise> {
     template <typename U>
-    static inline PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm,
+    static inline PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm,
                                       U&& fn) {
       return _error_sub_impl<Ret, PromiseT, _promise>::apply(
           pm, std::forward<U>(fn));
@@ -300,7 +717,7 @@ struct basic_promise {
   template <template <typename T> class PromiseT, typename _promise>
   struct _error_impl<void, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<void> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<void> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<void> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
       pm->error([t, arg_fn](std::exception_ptr&& err) mutable {
@@ -322,15 +739,16 @@ struct basic_promise {
             typename _promise>
   struct _finally_sub_impl {
     template <typename U>
-    static PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<Ret> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
       pm->finally([t, arg_fn]() mutable {
         try {
           auto tmp = arg_fn.borrow()();
-          tmp.then([t](Ret&& val) { t.resolve(std::move(val)); });
-          tmp.error(
-              [t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+          tmp.then([t](Ret&& val) { t.resolve(std::move(val)); })
+              .error([t](std::exception_ptr&& err) {
+                t.reject(std::move(err));
+              });
         } catch (...) {
           t.reject(std::current_exception());
         }
@@ -342,7 +760,7 @@ struct basic_promise {
   template <template <typename T> class PromiseT, typename _promise>
   struct _finally_sub_impl<void, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<void> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<void> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<void> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
       pm->finally([t, arg_fn]() mutable {
@@ -365,7 +783,7 @@ struct basic_promise {
             typename _promise>
   struct _finally_impl {
     template <typename U>
-    static PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<Ret> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
       pm->finally([t, arg_fn]() mutable {
@@ -383,7 +801,7 @@ struct basic_promise {
             typename _promise>
   struct _finally_impl<PromiseT<Ret>, PromiseT, _promise> {
     template <typename U>
-    static inline PromiseT<Ret> apply(const std::shared_ptr<_promise>& pm,
+    static inline PromiseT<Ret> apply(const detail::ref_ptr<_promise>& pm,
                                       U&& fn) {
       return _finally_sub_impl<Ret, PromiseT, _promise>::apply(
           pm, std::forward<U>(fn));
@@ -393,7 +811,7 @@ struct basic_promise {
   template <template <typename T> class PromiseT, typename _promise>
   struct _finally_impl<void, PromiseT, _promise> {
     template <typename U>
-    static PromiseT<void> apply(const std::shared_ptr<_promise>& pm, U&& fn) {
+    static PromiseT<void> apply(const detail::ref_ptr<_promise>& pm, U&& fn) {
       PromiseT<void> t;
       auto arg_fn = detail::capture(std::forward<U>(fn));
       pm->finally([t, arg_fn]() mutable {
@@ -437,114 +855,44 @@ struct promise : detail::basic_promise {
   using value_type = typename std::decay<T>::type;
 
  private:
-  class _promise {
-    status_t pm_status;
-    variant<T, std::exception_ptr> val;
-    detail::function<void(T&&)> then_cb;
-    // NOTE: 虽然说 cppreference 的示例中对 exception_ptr 使用值传递，
-    // 但引用计数的自增/自减是需要承担原子操作的开销的 (锁 bus)
-    // 所以不增加引用计数的右值引用传递方式可能更好。
-    detail::function<void(std::exception_ptr&&)> error_cb;
-    detail::function<void()> finally_cb;
-
+  class _promise
+      : public detail::promise_state<variant<T, std::exception_ptr>> {
    public:
-    _promise() = default;
-    _promise(const _promise&) = delete;
-    ~_promise() {
-      if (pm_status == rejected && !val.valueless_by_exception()) {
-        // Aborted due to unhandled rejection
-        std::abort();
-      }
-    }
-    void then(detail::function<void(T&&)>&& _then_cb) {
-      if (pm_status == fulfilled && (!val.valueless_by_exception())) {
-        _then_cb(std::move(get<0>(val)));
-        val = variant<T, std::exception_ptr>();
-      } else if (pm_status == pending && (!then_cb)) {
-        then_cb = std::move(_then_cb);
-      } else if (pm_status != rejected)
-        throw std::logic_error(
-            "Registered callback but the result has been already moved.");
-    }
-    void error(detail::function<void(std::exception_ptr&&)>&& _error_cb) {
-      if (pm_status == rejected && (!val.valueless_by_exception())) {
-        _error_cb(std::move(get<1>(val)));
-        val = variant<T, std::exception_ptr>();
-      } else if (pm_status == pending && (!error_cb)) {
-        error_cb = std::move(_error_cb);
-      } else if (pm_status != fulfilled)
-        throw std::logic_error(
-            "Registered callback but the result has been already moved.");
-    }
-    void finally(detail::function<void()>&& _finally_cb) {
-      if (pm_status == pending) {
-        if (!finally_cb)
-          finally_cb = std::move(_finally_cb);
-        else
-          throw std::logic_error(
-              "Registered callback but the result has been already moved.");
-      } else {
-        _finally_cb();
-      }
-    }
     void resolve(const T& value) {
-      val = value;
-      pm_status = fulfilled;
-      if (then_cb) {
-        then_cb(std::move(get<0>(val)));
-        val = variant<T, std::exception_ptr>();
-        then_cb = nullptr;
-      }
-      if (finally_cb) {
-        finally_cb();
-        finally_cb = nullptr;
-      }
+      this->val = value;
+      this->_settle(fulfilled);
     }
     void resolve(T&& value) {
-      val = std::move(value);
-      pm_status = fulfilled;
-      if (then_cb) {
-        then_cb(std::move(get<0>(val)));
-        val = variant<T, std::exception_ptr>();
-        then_cb = nullptr;
-        error_cb = nullptr;
-      }
-      if (finally_cb) {
-        finally_cb();
-        finally_cb = nullptr;
-      }
+      this->val = std::move(value);
+      this->_settle(fulfilled);
     }
     void reject(const std::exception_ptr& value) {
-      val = value;
-      pm_status = rejected;
-      if (error_cb) {
-        error_cb(std::move(get<1>(val)));
-        val = variant<T, std::exception_ptr>();
-        then_cb = nullptr;
-        error_cb = nullptr;
-      }
-      if (finally_cb) {
-        finally_cb();
-        finally_cb = nullptr;
-      }
+      this->val = value;
+      this->_settle(rejected);
     }
     void reject(std::exception_ptr&& value) {
-      val = value;
-      pm_status = rejected;
-      if (error_cb) {
-        error_cb(std::move(get<1>(val)));
-        val = variant<T, std::exception_ptr>();
-        then_cb = nullptr;
-        error_cb = nullptr;
-      }
-      if (finally_cb) {
-        finally_cb();
-        finally_cb = nullptr;
-      }
+      this->val = std::move(value);
+      this->_settle(rejected);
     }
-    inline constexpr status_t status() const noexcept { return pm_status; }
   };
-  std::shared_ptr<_promise> pm;
+  detail::ref_ptr<_promise> pm;
+  /**
+   * @brief 直接在此 promise 上注册回调，不创建新的 promise。
+   *
+   * @param on_fulfilled 完成时调用的函数。
+   * @param on_rejected 失败时调用的函数。
+   */
+  template <typename U, typename V>
+  inline void _subscribe(U&& on_fulfilled, V&& on_rejected) const {
+    pm->subscribe(std::forward<U>(on_fulfilled), std::forward<V>(on_rejected));
+  }
+  /**
+   * @brief 直接取走已完成的结果，见 detail::promise_state::take。
+   */
+  inline bool _take(variant<T, std::exception_ptr>& out) const {
+    return pm->take(out);
+  }
+  friend struct detail::promise_access;
 
  public:
   /**
@@ -626,9 +974,32 @@ struct promise : detail::basic_promise {
    * @return Status Promise的状态
    */
   inline status_t status() const noexcept { return pm->status(); }
-  explicit promise() : pm(new _promise()) {}
+  /**
+   * @brief 构造 promise。状态从当前线程的 frame_pool
+   * 申请，在事件循环中即为循环拥有的缓存，见 event_loop::set_arena_limit。
+   */
+  explicit promise()
+      : pm(detail::make_ref<_promise>(detail::frame_allocator<_promise>(),
+                                      _promise::default_atomic)) {}
+  /**
+   * @brief 构造线程安全的 promise：其引用计数总是使用原子操作，可以在线程
+   * 之间复制和销毁 (回调仍然不是线程安全的)。
+   */
+  explicit promise(thread_safe_t)
+      : pm(detail::make_ref<_promise>(detail::frame_allocator<_promise>(),
+                                      true)) {}
+  /**
+   * @brief 使用分配器构造 promise。状态与引用计数位于同一次分配中；回调记录
+   * 仍从 frame_pool 申请。
+   *
+   * @tparam Alloc 分配器类型。
+   * @param alloc 分配器。
+   */
+  template <typename Alloc>
+  promise(std::allocator_arg_t, const Alloc& alloc)
+      : pm(detail::make_ref<_promise>(alloc, _promise::default_atomic)) {}
   promise(const promise& v) : pm(v.pm) {}
-  promise(promise&& v) : pm(std::move(v.pm)) {}
+  promise(promise&& v) noexcept : pm(std::move(v.pm)) {}
   promise& operator=(const promise& v) {
     pm = v.pm;
     return *this;
@@ -643,95 +1014,34 @@ struct promise : detail::basic_promise {
  */
 template <>
 class promise<void> : detail::basic_promise {
-  class _promise {
-    status_t pm_status;
-    std::exception_ptr val;
-    detail::function<void()> then_cb;
-    // NOTE: 虽然说 cppreference 的示例中对 exception_ptr 使用值传递，
-    // 但引用计数的自增/自减是需要承担原子操作的开销的 (锁 bus)
-    // 所以不增加引用计数的右值引用传递方式可能更好。
-    detail::function<void(std::exception_ptr&&)> error_cb;
-    detail::function<void()> finally_cb;
-
+  class _promise : public detail::promise_state<std::exception_ptr> {
    public:
-    _promise() = default;
-    _promise(const _promise&) = delete;
-    ~_promise() {
-      if (pm_status == rejected && val) {
-        // Aborted due to unhandled rejection
-        std::abort();
-      }
-    }
-    inline void then(detail::function<void()>&& _then_cb) {
-      if (pm_status == fulfilled) {
-        _then_cb();
-      } else if (pm_status == pending && (!then_cb)) {
-        then_cb = std::move(_then_cb);
-      } else if (pm_status != rejected)
-        throw std::logic_error(
-            "Registered callback but the result has been already moved.");
-    }
-    inline void error(
-        detail::function<void(std::exception_ptr&&)>&& _error_cb) {
-      if (pm_status == rejected && val) {
-        _error_cb(std::move(val));
-        val = nullptr;
-      } else if (pm_status == pending && (!error_cb)) {
-        error_cb = std::move(_error_cb);
-      } else if (pm_status != fulfilled)
-        throw std::logic_error(
-            "Registered callback but the result has been already moved.");
-    }
-    inline void finally(detail::function<void()>&& _finally_cb) {
-      if (pm_status == pending) {
-        if (!finally_cb)
-          finally_cb = std::move(_finally_cb);
-        else
-          throw std::logic_error(
-              "Registered callback but the result has been already moved.");
-      } else {
-        _finally_cb();
-      }
-    }
-    void resolve() {
-      pm_status = fulfilled;
-      if (then_cb) {
-        then_cb();
-        then_cb = nullptr;
-      }
-      if (finally_cb) finally_cb();
-    }
+    void resolve() { _settle(fulfilled); }
     void reject(const std::exception_ptr& value) {
       val = value;
-      pm_status = rejected;
-      if (error_cb) {
-        error_cb(std::move(val));
-        val = nullptr;
-        then_cb = nullptr;
-        error_cb = nullptr;
-      }
-      if (finally_cb) {
-        finally_cb();
-        finally_cb = nullptr;
-      }
+      _settle(rejected);
     }
     void reject(std::exception_ptr&& value) {
-      val = value;
-      pm_status = rejected;
-      if (error_cb) {
-        error_cb(std::move(val));
-        val = nullptr;
-        then_cb = nullptr;
-        error_cb = nullptr;
-      }
-      if (finally_cb) {
-        finally_cb();
-        finally_cb = nullptr;
-      }
+      val = std::move(value);
+      _settle(rejected);
     }
-    inline constexpr status_t status() const noexcept { return pm_status; }
   };
-  std::shared_ptr<_promise> pm;
+  detail::ref_ptr<_promise> pm;
+  /**
+   * @brief 直接在此 promise 上注册回调，不创建新的 promise。
+   *
+   * @param on_fulfilled 完成时调用的函数。
+   * @param on_rejected 失败时调用的函数。
+   */
+  template <typename U, typename V>
+  inline void _subscribe(U&& on_fulfilled, V&& on_rejected) const {
+    pm->subscribe(std::forward<U>(on_fulfilled), std::forward<V>(on_rejected));
+  }
+  /**
+   * @brief 直接取走已完成的结果，见 detail::promise_state::take。
+   */
+  inline bool _take(std::exception_ptr& out) const { return pm->take(out); }
+  friend struct detail::promise_access;
 
  public:
   using value_type = void;
@@ -810,9 +1120,32 @@ class promise<void> : detail::basic_promise {
    * @return Status Promise的状态
    */
   inline status_t status() const noexcept { return pm->status(); }
-  explicit promise() : pm(new _promise()) {}
+  /**
+   * @brief 构造 promise。状态从当前线程的 frame_pool
+   * 申请，在事件循环中即为循环拥有的缓存，见 event_loop::set_arena_limit。
+   */
+  explicit promise()
+      : pm(detail::make_ref<_promise>(detail::frame_allocator<_promise>(),
+                                      _promise::default_atomic)) {}
+  /**
+   * @brief 构造线程安全的 promise：其引用计数总是使用原子操作，可以在线程
+   * 之间复制和销毁 (回调仍然不是线程安全的)。
+   */
+  explicit promise(thread_safe_t)
+      : pm(detail::make_ref<_promise>(detail::frame_allocator<_promise>(),
+                                      true)) {}
+  /**
+   * @brief 使用分配器构造 promise。状态与引用计数位于同一次分配中；回调记录
+   * 仍从 frame_pool 申请。
+   *
+   * @tparam Alloc 分配器类型。
+   * @param alloc 分配器。
+   */
+  template <typename Alloc>
+  promise(std::allocator_arg_t, const Alloc& alloc)
+      : pm(detail::make_ref<_promise>(alloc, _promise::default_atomic)) {}
   promise(const promise& v) : pm(v.pm) {}
-  promise(promise&& v) : pm(std::move(v.pm)) {}
+  promise(promise&& v) noexcept : pm(std::move(v.pm)) {}
   promise& operator=(const promise& v) {
     pm = v.pm;
     return *this;
@@ -962,8 +1295,10 @@ all(const promise<Args>&... args) {
   using ResultType =
       std::tuple<typename detail::replace_void<Args, monostate>::type...>;
   promise<ResultType> pm;
-  auto result = std::make_shared<ResultType>();
-  auto done_count = std::make_shared<std::size_t>(0);
+  auto result =
+      std::allocate_shared<ResultType>(detail::frame_allocator<char>());
+  auto done_count =
+      std::allocate_shared<std::size_t>(detail::frame_allocator<char>(), 0);
   detail::promise_all<ResultType, sizeof...(Args) - 1>::apply(
       pm, result, done_count, args...);
   return pm;
@@ -984,9 +1319,11 @@ any(const promise<Args>&... args) {
   promise<awacorn::unique_variant<
       typename detail::replace_void<Args, monostate>::type...>>
       pm;
-  auto fail_count = std::make_shared<std::size_t>(0);
+  auto fail_count =
+      std::allocate_shared<std::size_t>(detail::frame_allocator<char>(), 0);
   auto exce =
-      std::make_shared<std::array<std::exception_ptr, sizeof...(Args)>>();
+      std::allocate_shared<std::array<std::exception_ptr, sizeof...(Args)>>(
+          detail::frame_allocator<char>());
   detail::promise_any<sizeof...(Args), sizeof...(Args) - 1>::apply(
       pm, exce, fail_count, args...);
   return pm;
@@ -1026,13 +1363,309 @@ static inline promise<std::tuple<promise<Args>...>> all_settled(
     const promise<Args>&... args) {
   using ResultType = std::tuple<promise<Args>...>;
   promise<ResultType> pm;
-  auto result = std::make_shared<ResultType>();
-  auto done_count = std::make_shared<std::size_t>(0);
+  auto result =
+      std::allocate_shared<ResultType>(detail::frame_allocator<char>());
+  auto done_count =
+      std::allocate_shared<std::size_t>(detail::frame_allocator<char>(), 0);
   detail::promise_all_settled<ResultType, sizeof...(Args) - 1>::apply(
       pm, result, done_count, args...);
   return pm;
 }
 }  // namespace gather
+namespace detail {
+/**
+ * @brief 供 await 实现使用的 promise 底层接口。
+ */
+struct promise_access {
+  /**
+   * @brief 直接在 pm 上注册回调，不创建新的 promise。
+   */
+  template <typename T, typename U, typename V>
+  static inline void subscribe(const promise<T>& pm, U&& on_fulfilled,
+                               V&& on_rejected) {
+    pm._subscribe(std::forward<U>(on_fulfilled), std::forward<V>(on_rejected));
+  }
+  /**
+   * @brief pm 已完成且结果尚未被取走时直接取走结果，不注册回调。
+   *
+   * @param out 用于接收结果。对 promise<T> 为 variant<T, std::exception_ptr>，
+   * 对 promise<void> 为 std::exception_ptr。
+   * @return true 取得了结果。
+   */
+  template <typename T, typename Slot>
+  static inline bool take(const promise<T>& pm, Slot& out) {
+    return pm._take(out);
+  }
+};
+};  // namespace detail
+/**
+ * @brief 可以被多次订阅的 promise。
+ *
+ * 结果保存在共享状态中，不会被取走：每个订阅者都以 const
+ * 引用取得同一个值，错误则传递副本。订阅者以回调记录的链表保存在状态上，
+ * subscribe 不创建新的 promise，只申请一条 (来自 frame_pool 的) 记录。
+ * 回调按注册顺序调用，完成之后注册的回调同样会被调用。
+ *
+ * 没有订阅者的失败不会中止程序。
+ *
+ * @tparam T 结果类型。
+ */
+template <typename T>
+class shared_promise : detail::basic_promise {
+ public:
+  using value_type = typename std::decay<T>::type;
+
+ private:
+  class _promise
+      : public detail::shared_state<variant<T, std::exception_ptr>> {
+   public:
+    void resolve(const T& value) {
+      this->val = value;
+      this->_settle(fulfilled);
+    }
+    void resolve(T&& value) {
+      this->val = std::move(value);
+      this->_settle(fulfilled);
+    }
+    void reject(const std::exception_ptr& value) {
+      this->val = value;
+      this->_settle(rejected);
+    }
+    void reject(std::exception_ptr&& value) {
+      this->val = std::move(value);
+      this->_settle(rejected);
+    }
+  };
+  detail::ref_ptr<_promise> pm;
+
+ public:
+  /**
+   * @brief 直接在共享状态上注册回调，不创建新的 promise。
+   *
+   * @param on_fulfilled 完成时以 const value_type& 调用的函数。
+   * @param on_rejected 失败时以 std::exception_ptr&& 调用的函数。
+   */
+  template <typename U, typename V>
+  inline void subscribe(U&& on_fulfilled, V&& on_rejected) const {
+    pm->subscribe(std::forward<U>(on_fulfilled), std::forward<V>(on_rejected));
+  }
+  /**
+   * @brief 设定在 promise 完成后执行的函数，见 promise::then。函数以 const
+   * value_type& 取得结果。
+   */
+  template <typename U>
+  inline auto then(U&& fn) const -> promise<typename detail::extract_from<
+      decltype(fn(std::declval<const value_type&>())), promise>::type> {
+    using Ret = decltype(fn(std::declval<const value_type&>()));
+    return _then_impl<Ret, const value_type&, promise, _promise>::apply(
+        pm, std::forward<U>(fn));
+  }
+  /**
+   * @brief 设定在 promise 发生错误后执行的函数，见 promise::error。
+   */
+  template <typename U>
+  inline auto error(U&& fn) const -> promise<typename detail::extract_from<
+      decltype(fn(std::declval<std::exception_ptr>())), promise>::type> {
+    using Ret = decltype(fn(std::declval<std::exception_ptr>()));
+    return _error_impl<Ret, promise, _promise>::apply(pm, std::forward<U>(fn));
+  }
+  /**
+   * @brief 设定无论结果如何都会执行的函数，见 promise::finally。
+   */
+  template <typename U>
+  inline auto finally(U&& fn) const
+      -> promise<typename detail::extract_from<decltype(fn()), promise>::type> {
+    using Ret = decltype(fn());
+    return _finally_impl<Ret, promise, _promise>::apply(pm,
+                                                        std::forward<U>(fn));
+  }
+  /**
+   * @brief 完成此 promise。
+   *
+   * @param value 结果值。
+   */
+  inline void resolve(const value_type& value) const { pm->resolve(value); }
+  inline void resolve(value_type&& value) const {
+    pm->resolve(std::move(value));
+  }
+  /**
+   * @brief 拒绝此 promise。
+   *
+   * @param err 异常。
+   */
+  inline void reject(const std::exception_ptr& value) const {
+    pm->reject(value);
+  }
+  inline void reject(std::exception_ptr&& value) const {
+    pm->reject(std::move(value));
+  }
+  /**
+   * @brief 获得已完成的结果。
+   *
+   * @return const value_type& 结果，与 shared_promise 的共享状态同生命周期。
+   * @throw std::logic_error 尚未完成。失败时重新抛出其错误。
+   */
+  const value_type& value() const {
+    if (pm->status() == pending)
+      throw std::logic_error("The shared_promise is still pending.");
+    variant<T, std::exception_ptr>& result = pm->result();
+    if (result.index() == 1) std::rethrow_exception(get<1>(result));
+    return get<0>(result);
+  }
+  /**
+   * @brief 获得 promise 的状态。
+   */
+  inline status_t status() const noexcept { return pm->status(); }
+  explicit shared_promise()
+      : pm(detail::make_ref<_promise>(detail::frame_allocator<_promise>(),
+                                      _promise::default_atomic)) {}
+  /**
+   * @brief 以 source 的结果完成。source 的结果由 shared_promise 取走。
+   *
+   * @param source 原 promise。
+   */
+  explicit shared_promise(const promise<T>& source) : shared_promise() {
+    detail::ref_ptr<_promise> state(pm);
+    detail::promise_access::subscribe(
+        source, [state](T&& value) { state->resolve(std::move(value)); },
+        [state](std::exception_ptr&& err) { state->reject(std::move(err)); });
+  }
+  shared_promise(const shared_promise& v) : pm(v.pm) {}
+  shared_promise(shared_promise&& v) noexcept : pm(std::move(v.pm)) {}
+  shared_promise& operator=(const shared_promise& v) {
+    pm = v.pm;
+    return *this;
+  }
+  shared_promise& operator=(shared_promise&& v) noexcept {
+    pm = std::move(v.pm);
+    return *this;
+  }
+};
+/**
+ * @brief 没有值的 shared_promise。
+ */
+template <>
+class shared_promise<void> : detail::basic_promise {
+  class _promise : public detail::shared_state<std::exception_ptr> {
+   public:
+    void resolve() { _settle(fulfilled); }
+    void reject(const std::exception_ptr& value) {
+      val = value;
+      _settle(rejected);
+    }
+    void reject(std::exception_ptr&& value) {
+      val = std::move(value);
+      _settle(rejected);
+    }
+  };
+  detail::ref_ptr<_promise> pm;
+  /**
+   * @brief then 的 void() 回调不转发错误 (以便在同一个 promise 上另外注册
+   * error)。共享状态可以注册任意多条记录，因此在这里补上转发。
+   */
+  inline void _forward_error(const promise<void>& t, std::true_type) const {
+    pm->error([t](std::exception_ptr&& err) { t.reject(std::move(err)); });
+  }
+  template <typename P>
+  inline void _forward_error(const P&, std::false_type) const noexcept {}
+
+ public:
+  using value_type = void;
+  /**
+   * @brief 直接在共享状态上注册回调，不创建新的 promise。
+   *
+   * @param on_fulfilled 完成时调用的函数。
+   * @param on_rejected 失败时以 std::exception_ptr&& 调用的函数。
+   */
+  template <typename U, typename V>
+  inline void subscribe(U&& on_fulfilled, V&& on_rejected) const {
+    pm->subscribe(std::forward<U>(on_fulfilled), std::forward<V>(on_rejected));
+  }
+  /**
+   * @brief 设定在 promise 完成后执行的函数，见 promise::then。
+   */
+  template <typename U>
+  inline auto then(U&& fn) const
+      -> promise<typename detail::extract_from<decltype(fn()), promise>::type> {
+    using Ret = decltype(fn());
+    auto t = _then_impl<Ret, void, promise, _promise>::apply(
+        pm, std::forward<U>(fn));
+    _forward_error(t, std::is_void<Ret>());
+    return t;
+  }
+  /**
+   * @brief 设定在 promise 发生错误后执行的函数，见 promise::error。
+   */
+  template <typename U>
+  inline auto error(U&& fn) const -> promise<typename detail::extract_from<
+      decltype(fn(std::declval<std::exception_ptr>())), promise>::type> {
+    using Ret = decltype(fn(std::declval<std::exception_ptr>()));
+    return _error_impl<Ret, promise, _promise>::apply(pm, std::forward<U>(fn));
+  }
+  /**
+   * @brief 设定无论结果如何都会执行的函数，见 promise::finally。
+   */
+  template <typename U>
+  inline auto finally(U&& fn) const
+      -> promise<typename detail::extract_from<decltype(fn()), promise>::type> {
+    using Ret = decltype(fn());
+    return _finally_impl<Ret, promise, _promise>::apply(pm,
+                                                        std::forward<U>(fn));
+  }
+  /**
+   * @brief 完成此 promise。
+   */
+  inline void resolve() const { pm->resolve(); }
+  /**
+   * @brief 拒绝此 promise。
+   *
+   * @param err 异常。
+   */
+  inline void reject(const std::exception_ptr& value) const {
+    pm->reject(value);
+  }
+  inline void reject(std::exception_ptr&& value) const {
+    pm->reject(std::move(value));
+  }
+  /**
+   * @brief 检查已完成的结果。
+   *
+   * @throw std::logic_error 尚未完成。失败时重新抛出其错误。
+   */
+  void value() const {
+    if (pm->status() == pending)
+      throw std::logic_error("The shared_promise is still pending.");
+    if (pm->result()) std::rethrow_exception(pm->result());
+  }
+  /**
+   * @brief 获得 promise 的状态。
+   */
+  inline status_t status() const noexcept { return pm->status(); }
+  explicit shared_promise()
+      : pm(detail::make_ref<_promise>(detail::frame_allocator<_promise>(),
+                                      _promise::default_atomic)) {}
+  /**
+   * @brief 以 source 的结果完成。source 的结果由 shared_promise 取走。
+   *
+   * @param source 原 promise。
+   */
+  explicit shared_promise(const promise<void>& source) : shared_promise() {
+    detail::ref_ptr<_promise> state(pm);
+    detail::promise_access::subscribe(
+        source, [state]() { state->resolve(); },
+        [state](std::exception_ptr&& err) { state->reject(std::move(err)); });
+  }
+  shared_promise(const shared_promise& v) : pm(v.pm) {}
+  shared_promise(shared_promise&& v) noexcept : pm(std::move(v.pm)) {}
+  shared_promise& operator=(const shared_promise& v) {
+    pm = v.pm;
+    return *this;
+  }
+  shared_promise& operator=(shared_promise&& v) noexcept {
+    pm = std::move(v.pm);
+    return *this;
+  }
+};
 /**
  * @brief 返回一个已经 fulfilled 的 Promise。
  *
@@ -0,0 +1,89 @@
+#ifndef _AWACORN_TEST_ALLOC_COUNT_
+#define _AWACORN_TEST_ALLOC_COUNT_
+/**
+ * 替换全局 operator new / operator delete，统计 operator new
+ * 的调用次数。每个测试程序只能在一个源文件中包含。
+ */
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "promise.hpp"
+namespace alloc_count {
+namespace detail {
+static std::size_t allocations = 0;
+static std::size_t last_size = 0;
+};  // namespace detail
+/**
+ * @brief 上次 reset 之后 operator new 的调用次数。
+ */
+inline std::size_t allocations() noexcept { return detail::allocations; }
+/**
+ * @brief 最近一次 operator new 申请的字节数。
+ */
+inline std::size_t last_size() noexcept { return detail::last_size; }
+/**
+ * @brief 清零调用次数。
+ */
+inline void reset() noexcept { detail::allocations = 0; }
+/**
+ * @brief 清零调用次数后调用 n 次 step(i)，返回平均每次调用 operator new
+ * 的次数。
+ *
+ * @param us 不为 nullptr 时用于接收总耗时 (微秒)。
+ */
+template <typename F>
+double measure(std::size_t n, F&& step, long double* us = nullptr) {
+  reset();
+  auto tm = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < n; i++) step(i);
+  if (us)
+    *us = std::chrono::duration_cast<
+              std::chrono::duration<long double, std::micro>>(
+              std::chrono::high_resolution_clock::now() - tm)
+              .count();
+  return double(allocations()) / n;
+}
+/**
+ * @brief 预先创建 n 个 promise，对第 i 个调用 attach(promise) 后以 i
+ * 完成它，输出耗时并返回平均每个 promise 调用 operator new 的次数。
+ *
+ * @param sum attach 注册的回调累加结果的位置。调用前清零，结束时应为
+ * 0 + 1 + ... + (n - 1)，否则返回 -1。
+ */
+template <typename Attach>
+double resolve_each(const char* name, std::size_t n, std::size_t& sum,
+                    Attach&& attach) {
+  std::vector<awacorn::promise<std::size_t>> pms(n);
+  sum = 0;
+  long double us = 0;
+  double per_call = measure(
+      n,
+      [&](std::size_t i) {
+        attach(pms[i]);
+        pms[i].resolve(i);
+      },
+      &us);
+  std::cout << name << ": " << n << " promises in " << us << "us ("
+            << per_call << " allocations each)" << std::endl;
+  return sum == n * (n - 1) / 2 ? per_call : -1;
+}
+};  // namespace alloc_count
+// 禁止内联，避免 GCC 在内联后误报 -Wmismatched-new-delete。
+__attribute__((noinline)) void* operator new(std::size_t size) {
+  alloc_count::detail::allocations++;
+  alloc_count::detail::last_size = size;
+  if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+  throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+__attribute__((noinline)) void operator delete(void* ptr,
+                                               std::size_t) noexcept {
+  std::free(ptr);
+}
+#endif
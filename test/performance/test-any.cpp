@@ -0,0 +1,60 @@
+#include <array>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+#include "alloc_count.hpp"
+#include "detail/unsafe_any.hpp"
+#include "promise.hpp"
+constexpr std::size_t n = 1000000;
+// 防止取出的值被优化掉。
+static const void* volatile sink = nullptr;
+// 装箱、移动、取出 n 次由 make(i) 得到的值，返回 operator new 的调用次数。
+template <typename T, typename Make>
+std::size_t measure(const char* name, Make&& make) {
+  alloc_count::reset();
+  auto tm = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < n; i++) {
+    T value = make(i);
+    awacorn::detail::unsafe_any v(std::move(value));
+    awacorn::detail::unsafe_any moved = std::move(v);
+    T result = awacorn::detail::unsafe_cast<T>(std::move(moved));
+    sink = &result;
+  }
+  const std::size_t allocated = alloc_count::allocations();
+  std::cout << name << ": "
+            << std::chrono::duration_cast<
+                   std::chrono::duration<long double, std::micro>>(
+                   std::chrono::high_resolution_clock::now() - tm)
+                   .count()
+            << "us (" << allocated << " allocations)" << std::endl;
+  return allocated;
+}
+int main() {
+  std::exception_ptr err =
+      std::make_exception_ptr(std::runtime_error("test"));
+  awacorn::promise<int> pm;
+  // 小对象不应申请内存。
+  if (measure<int>("int", [](std::size_t i) { return int(i); }) ||
+      measure<std::exception_ptr>("exception_ptr",
+                                  [&err](std::size_t) { return err; }) ||
+      measure<awacorn::promise<int>>("promise",
+                                     [&pm](std::size_t) { return pm; }))
+    return 1;
+  // 大对象仍存放在堆上，每次申请一次。
+  if (measure<std::array<std::size_t, 8>>(
+          "large", [](std::size_t i) {
+            return std::array<std::size_t, 8>{{i}};
+          }) != n)
+    return 1;
+  // 只允许移动的对象可以存放，但不允许复制。
+  awacorn::detail::unsafe_any ptr(std::unique_ptr<int>(new int(1)));
+  try {
+    awacorn::detail::unsafe_any copy(ptr);
+    return 1;
+  } catch (const std::logic_error&) {
+  }
+  if (*awacorn::detail::unsafe_cast<std::unique_ptr<int>>(ptr) != 1) return 1;
+}
@@ -0,0 +1,45 @@
+#include <chrono>
+#include <iostream>
+#include <tuple>
+
+#include "alloc_count.hpp"
+#include "event.hpp"
+#include "promise.hpp"
+constexpr std::size_t steps = 100000;
+// 每步创建两个 promise，用 gather::all 汇总并接一条 then 链后完成它们。在
+// 事件循环内运行，返回平均每步调用 operator new 的次数。
+double measure(const char* name, std::size_t limit) {
+  awacorn::event_loop ev;
+  ev.set_arena_limit(limit);
+  std::size_t sum = 0;
+  double per_step = -1;
+  long double us = 0;
+  ev.event(
+      [&]() {
+        auto step = [&sum](std::size_t i) {
+          awacorn::promise<std::size_t> a, b;
+          awacorn::gather::all(a, b)
+              .then([](std::tuple<std::size_t, std::size_t>&& v) {
+                return std::get<0>(v) + std::get<1>(v);
+              })
+              .then([&sum](std::size_t v) { sum += v; });
+          a.resolve(i);
+          b.resolve(1);
+        };
+        // 第一步填充缓存。
+        step(0);
+        sum = 0;
+        per_step = alloc_count::measure(steps, step, &us);
+      },
+      std::chrono::milliseconds(0));
+  ev.start();
+  std::cout << name << ": " << steps << " steps in " << us << "us ("
+            << per_step << " allocations each)" << std::endl;
+  if (sum != steps * (steps - 1) / 2 + steps) return -1;
+  return per_step;
+}
+int main() {
+  double uncached = measure("without arena", 0);
+  double cached = measure("with arena", 256);
+  if (uncached < 0 || cached < 0 || cached > 0.01 || uncached < 1) return 1;
+}
@@ -0,0 +1,55 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "alloc_count.hpp"
+#include "async.hpp"
+#include "event.hpp"
+#include "promise.hpp"
+constexpr std::size_t awaits = 100000;
+int main() {
+  // 1. await 尚未完成的 promise。预先创建 promise，只统计 await 本身的开销。
+  std::vector<awacorn::promise<std::size_t>> pms(awaits);
+  std::size_t sum = 0;
+  auto done = awacorn::async([&](awacorn::context& ctx) {
+    for (std::size_t i = 0; i < awaits; i++) sum += ctx >> pms[i];
+    return sum;
+  });
+  // 每次 resolve 都会恢复协程，直到它 await 下一个 promise。第一次恢复时
+  // 新旧两次 await 的凭证同时存在，先由它填充缓存。
+  pms[0].resolve(0);
+  long double pending_tm = 0;
+  double pending_alloc = alloc_count::measure(
+      awaits - 1, [&pms](std::size_t i) { pms[i + 1].resolve(i + 1); },
+      &pending_tm);
+  std::size_t result = 0;
+  done.then([&](std::size_t v) { result = v; });
+  if (result != awaits * (awaits - 1) / 2 || pending_alloc) return 1;
+  // 2. await 已完成的 promise。即使启用了 microtask，也应同步取得结果而不切出
+  // 协程。
+  for (std::size_t i = 0; i < awaits; i++) {
+    pms[i] = awacorn::promise<std::size_t>();
+    pms[i].resolve(i);
+  }
+  awacorn::event_loop ev;
+  ev.set_microtask(true);
+  bool sync = false, finished = false;
+  double settled_alloc = 0;
+  long double settled_tm = 0;
+  ev.event(
+      [&]() {
+        awacorn::async([&](awacorn::context& ctx) {
+          settled_alloc = alloc_count::measure(
+              awaits, [&](std::size_t i) { ctx >> pms[i]; }, &settled_tm);
+          finished = true;
+        });
+        sync = finished;
+      },
+      std::chrono::milliseconds(0));
+  ev.start();
+  std::cout << awaits << " awaits on pending promises (" << pending_tm
+            << "us, " << pending_alloc << " allocations), " << awaits
+            << " awaits on settled promises (" << settled_tm << "us, "
+            << settled_alloc << " allocations)" << std::endl;
+  if (!sync || !finished || settled_alloc) return 1;
+}
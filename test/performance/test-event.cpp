@@ -0,0 +1,54 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#include "alloc_count.hpp"
+#include "event.hpp"
+constexpr std::size_t warmup = 1000;
+constexpr std::size_t cycles = 1000000;
+// 每个事件触发时注册下一个事件，直到达到 n 次。
+struct chain {
+  awacorn::event_loop* ev;
+  std::size_t* count;
+  std::size_t n;
+  void operator()() {
+    if (++*count < n) ev->event(chain{ev, count, n}, std::chrono::seconds(0));
+  }
+};
+// 捕获过对齐对象的回调，无法内联存储在 function 中，由循环的 pool 申请。
+struct aligned_cb {
+  struct alignas(64) block {
+    char data[64];
+  } value;
+  std::size_t* misaligned;
+  void operator()() {
+    // 经过 volatile 读取地址，避免编译器依据类型的对齐假设消去检查。
+    volatile std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(&value);
+    if (addr % alignof(block)) ++*misaligned;
+  }
+};
+int main() {
+  awacorn::event_loop ev;
+  std::size_t count = 0;
+  ev.event(chain{&ev, &count, warmup}, std::chrono::seconds(0));
+  ev.start();
+  count = 0;
+  alloc_count::reset();
+  auto tm = std::chrono::high_resolution_clock::now();
+  ev.event(chain{&ev, &count, cycles}, std::chrono::seconds(0));
+  ev.start();
+  auto elapsed = std::chrono::high_resolution_clock::now() - tm;
+  const std::size_t allocated = alloc_count::allocations();
+  std::cout << cycles << " schedule-fire cycles, " << allocated
+            << " allocations ("
+            << std::chrono::duration_cast<
+                   std::chrono::duration<long double, std::micro>>(elapsed)
+                   .count()
+            << "us)" << std::endl;
+  if (count != cycles || allocated) return 1;
+  std::size_t misaligned = 0;
+  for (int i = 0; i < 64; i++)
+    ev.event(aligned_cb{{}, &misaligned}, std::chrono::seconds(0));
+  ev.start();
+  return misaligned ? 1 : 0;
+}
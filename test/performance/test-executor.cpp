@@ -0,0 +1,74 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+
+#include "async.hpp"
+#include "executor.hpp"
+constexpr std::size_t tasks = 512;
+// 纯计算任务，没有 I/O 和定时事件。
+std::uint64_t work(std::uint64_t seed) {
+  for (std::size_t i = 0; i < 200000; i++)
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return seed;
+}
+// 所有任务都从第 0 个工作线程提交，其它线程只能靠窃取获得任务。
+long double run(std::size_t n, std::uint64_t& sum) {
+  awacorn::executor ex(n);
+  sum = 0;
+  std::size_t done = 0;
+  auto tm = std::chrono::high_resolution_clock::now();
+  ex.loop(0).event(
+      [&]() {
+        for (std::size_t i = 0; i < tasks; i++) {
+          ex.spawn([i]() { return work(i); }).then([&](std::uint64_t v) {
+            sum += v;
+            if (++done == tasks) ex.stop();
+          });
+        }
+      },
+      std::chrono::milliseconds(0));
+  ex.start();
+  if (done != tasks) std::exit(1);
+  return std::chrono::duration_cast<
+             std::chrono::duration<long double, std::micro>>(
+             std::chrono::high_resolution_clock::now() - tm)
+      .count();
+}
+int main() {
+  std::size_t n = std::thread::hardware_concurrency();
+  if (n < 2) n = 2;
+  std::uint64_t single, multi;
+  long double single_tm = run(1, single);
+  long double multi_tm = run(n, multi);
+  if (single != multi) return 1;
+  std::cout << tasks << " tasks: 1 thread " << single_tm << "us, " << n
+            << " threads " << multi_tm << "us" << std::endl;
+  // 协程通过 schedule 让出线程后可能在其它线程恢复，定时事件仍留在注册它的
+  // 线程。
+  awacorn::executor ex(n);
+  bool ok = true;
+  ex.loop(0).event(
+      [&]() {
+        awacorn::async([&](awacorn::context& ctx) {
+          for (std::size_t i = 0; i < 16; i++) {
+            ctx >> ex.schedule();
+            awacorn::event_loop* ev = awacorn::executor::current();
+            std::thread::id id = std::this_thread::get_id();
+            awacorn::promise<void> pm;
+            ev->event([pm]() { pm.resolve(); }, std::chrono::milliseconds(1));
+            ctx >> pm;
+            if (std::this_thread::get_id() != id) ok = false;
+          }
+          try {
+            ctx >> ex.spawn([]() -> int { throw std::runtime_error("x"); });
+            ok = false;
+          } catch (const std::runtime_error&) {
+          }
+          ex.stop();
+        });
+      },
+      std::chrono::milliseconds(0));
+  ex.start();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#include <iostream>
+
+#include "alloc_count.hpp"
+#include "async.hpp"
+#include "promise.hpp"
+constexpr std::size_t calls = 100000;
+using pm_t = awacorn::promise<std::size_t>;
+int main() {
+  // 预热：填充栈池和帧池。
+  awacorn::async([](awacorn::context&) {});
+  // 创建 calls 个 "await 一次后返回" 的协程，统计平均每个协程调用
+  // operator new 的次数。协程依次创建、完成并销毁，帧被回收复用。
+  std::size_t sum = 0;
+  // 1. 小的函数对象，存放在 function 内部。
+  double small = alloc_count::resolve_each("small", calls, sum, [&](pm_t& pm) {
+    awacorn::async([pm, &sum](awacorn::context& ctx) { sum += ctx >> pm; });
+  });
+  // 2. 较大的函数对象，同样从帧池取得。
+  std::size_t a = 0, b = 0;
+  double large = alloc_count::resolve_each("large", calls, sum, [&](pm_t& pm) {
+    awacorn::async([pm, &sum, &a, &b](awacorn::context& ctx) {
+      sum += (ctx >> pm) + a + b;
+    });
+  });
+  // 第一次使用某个大小级别时仍需申请内存，之后应全部复用。
+  if (small < 0 || large < 0 || small > 0.01 || large > 0.01) return 1;
+}
@@ -0,0 +1,54 @@
+#include <array>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+#include "alloc_count.hpp"
+#include "detail/function.hpp"
+#include "promise.hpp"
+constexpr std::size_t n = 1000000;
+// 构造、移动、调用 n 次由 make(i) 得到的可调用对象。
+template <typename Fn, typename Make>
+long double measure(std::size_t& sum, std::size_t& allocated, Make&& make) {
+  alloc_count::reset();
+  auto tm = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < n; i++) {
+    Fn fn = make(i);
+    Fn moved = std::move(fn);
+    sum += moved();
+  }
+  allocated = alloc_count::allocations();
+  return std::chrono::duration_cast<
+             std::chrono::duration<long double, std::micro>>(
+             std::chrono::high_resolution_clock::now() - tm)
+      .count();
+}
+template <template <typename> class Fn>
+bool run(const char* name) {
+  std::size_t sum = 0, small = 0, pm = 0, large = 0;
+  awacorn::promise<int> p;
+  long double t1 = measure<Fn<std::size_t()>>(sum, small, [](std::size_t i) {
+    std::size_t* ptr = &i;
+    return [ptr, i]() { return i + (ptr != nullptr); };
+  });
+  long double t2 = measure<Fn<std::size_t()>>(sum, pm, [&p](std::size_t i) {
+    return [p, i]() { return i; };
+  });
+  long double t3 = measure<Fn<std::size_t()>>(sum, large, [](std::size_t i) {
+    std::array<std::size_t, 8> data{{i}};
+    return [data]() { return data[0]; };
+  });
+  std::cout << name << ": small " << t1 << "us (" << small
+            << " allocations), promise " << t2 << "us (" << pm
+            << " allocations), large " << t3 << "us (" << large
+            << " allocations), checksum " << sum << std::endl;
+  return small == 0 && pm == 0 && large == n;
+}
+template <typename T>
+using std_function = std::function<T>;
+template <typename T>
+using awacorn_function = awacorn::detail::function<T>;
+int main() {
+  run<std_function>("std::function");
+  if (!run<awacorn_function>("awacorn::detail::function")) return 1;
+}
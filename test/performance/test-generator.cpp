@@ -0,0 +1,100 @@
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "async.hpp"
+#include "promise.hpp"
+constexpr std::size_t items = 1000000;
+long double elapsed(std::chrono::high_resolution_clock::time_point tm) {
+  return std::chrono::duration_cast<
+             std::chrono::duration<long double, std::micro>>(
+             std::chrono::high_resolution_clock::now() - tm)
+      .count();
+}
+int main() {
+  // 1. 逐个取得 items 个值，与先构建整个 vector 比较。
+  std::size_t sum = 0;
+  auto tm = std::chrono::high_resolution_clock::now();
+  awacorn::async([&sum](awacorn::context& ctx) {
+    awacorn::async_generator<std::size_t> gen(
+        [](awacorn::generator_context<std::size_t>& ctx) {
+          for (std::size_t i = 0; i < items; i++) ctx.yield(i);
+        });
+    while (awacorn::optional<std::size_t> v = ctx >> gen.next()) sum += *v;
+  });
+  long double streamed = elapsed(tm);
+  std::size_t sum2 = 0;
+  tm = std::chrono::high_resolution_clock::now();
+  awacorn::async([&sum2](awacorn::context&) {
+    std::vector<std::size_t> all;
+    for (std::size_t i = 0; i < items; i++) all.push_back(i);
+    return all;
+  }).then([&sum2](std::vector<std::size_t>&& all) {
+    for (auto&& v : all) sum2 += v;
+  });
+  long double collected = elapsed(tm);
+  std::cout << items << " items: generator " << streamed << "us, vector "
+            << collected << "us (" << items * sizeof(std::size_t)
+            << " bytes buffered)" << std::endl;
+  if (sum != items * (items - 1) / 2 || sum != sum2) return 1;
+  // 2. 生成器在 yield 之间 await，且不会超前于调用方运行。
+  std::vector<awacorn::promise<int>> pms(4);
+  std::size_t produced = 0;
+  awacorn::async_generator<int> gen([&](awacorn::generator_context<int>& ctx) {
+    for (auto&& pm : pms) {
+      produced++;
+      ctx.yield(ctx >> pm);
+    }
+  });
+  int total = 0;
+  std::size_t consumed = 0;
+  bool finished = false;
+  awacorn::async([&](awacorn::context& ctx) {
+    while (awacorn::optional<int> v = ctx >> gen.next()) {
+      total += *v;
+      consumed++;
+    }
+    finished = true;
+  });
+  for (std::size_t i = 0; i < pms.size(); i++) {
+    if (produced != consumed + 1) return 1;
+    pms[i].resolve(int(i) + 1);
+  }
+  if (!finished || total != 10 || !gen.done()) return 1;
+  // 3. 上一次 next 尚未完成时再次调用会抛出异常；生成器的异常使 next 失败。
+  awacorn::promise<void> wait;
+  awacorn::async_generator<int> failing(
+      [&wait](awacorn::generator_context<int>& ctx) {
+        ctx >> wait;
+        throw std::runtime_error("x");
+      });
+  bool rejected = false;
+  failing.next().error([&rejected](std::exception_ptr&&) { rejected = true; });
+  try {
+    failing.next();
+    return 1;
+  } catch (const std::logic_error&) {
+  }
+  wait.resolve();
+  bool empty = false;
+  failing.next().then(
+      [&empty](awacorn::optional<int>&& v) { empty = !v.has_value(); });
+  if (!rejected || !empty) return 1;
+  // 4. 析构挂起在 yield 中的生成器会展开其栈。
+  struct guard {
+    bool& flag;
+    ~guard() { flag = true; }
+  };
+  bool unwound = false;
+  {
+    awacorn::async_generator<int> partial(
+        [&unwound](awacorn::generator_context<int>& ctx) {
+          guard g{unwound};
+          for (int i = 0;; i++) ctx.yield(i);
+        });
+    partial.next();
+    partial.next();
+  }
+  return unwound ? 0 : 1;
+}
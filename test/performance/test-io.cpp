@@ -0,0 +1,57 @@
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#include "event.hpp"
+#include "promise.hpp"
+constexpr std::size_t rounds = 10000;
+struct peer {
+  awacorn::event_loop* ev;
+  int fd;
+  char buf;
+  std::size_t count;
+};
+// 收到一个字节后原样发回，直到完成 rounds 次。
+void echo(peer* self) {
+  self->ev->read(self->fd, &self->buf, 1)
+      .then([self](int n) {
+        if (n != 1) throw std::runtime_error("short read");
+        return self->ev->write(self->fd, &self->buf, 1);
+      })
+      .then([self](int) {
+        if (++self->count < rounds) echo(self);
+      })
+      .error([](std::exception_ptr) { std::exit(1); });
+}
+int main() {
+  int fd[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fd) == -1) return 1;
+  awacorn::event_loop ev;
+  peer a{&ev, fd[0], 'x', 0}, b{&ev, fd[1], 0, 0};
+  std::chrono::high_resolution_clock::time_point tm =
+      std::chrono::high_resolution_clock::now();
+  // a 先发出一个字节，之后两端都以 echo 的方式往返。
+  ev.write(a.fd, &a.buf, 1).then([&](int) { echo(&a); });
+  echo(&b);
+  ev.start();
+  if (a.count != rounds || b.count != rounds) return 1;
+  std::cout << rounds << " round trips ("
+#if defined(AWACORN_USE_IO_URING)
+            << "io_uring"
+#else
+            << "epoll"
+#endif
+            << ", "
+            << std::chrono::duration_cast<
+                   std::chrono::duration<long double, std::micro>>(
+                   std::chrono::high_resolution_clock::now() - tm)
+                   .count()
+            << "us)" << std::endl;
+  close(fd[0]);
+  close(fd[1]);
+}
@@ -0,0 +1,94 @@
+#include <chrono>
+#include <iostream>
+
+#include "async.hpp"
+#include "event.hpp"
+#include "promise.hpp"
+constexpr std::size_t chain = 1000000;
+constexpr std::size_t awaits = 1000000;
+template <typename Fn>
+long double measure(Fn&& fn) {
+  auto tm = std::chrono::high_resolution_clock::now();
+  fn();
+  return std::chrono::duration_cast<
+             std::chrono::duration<long double, std::micro>>(
+             std::chrono::high_resolution_clock::now() - tm)
+      .count();
+}
+int main() {
+  awacorn::event_loop ev;
+  ev.set_microtask(true);
+  // 1. 很长的 then 链。同步执行时每一级都会多占用一层调用栈。
+  std::size_t count = 0;
+  long double chain_tm = measure([&]() {
+    awacorn::promise<std::size_t> head;
+    awacorn::promise<std::size_t> tail = head;
+    for (std::size_t i = 0; i < chain; i++)
+      tail = tail.then([&](std::size_t v) {
+        count++;
+        return v + 1;
+      });
+    tail.then([&](std::size_t v) { count = v == chain ? count : 0; });
+    ev.event([&]() { head.resolve(0); }, std::chrono::milliseconds(0));
+    ev.start();
+  });
+  if (count != chain) return 1;
+  // 2. 在 64 KiB 的协程栈上紧凑地 await 已完成的 promise。
+  std::size_t sum = 0;
+  long double await_tm = measure([&]() {
+    ev.event(
+        [&]() {
+          awacorn::async(
+              [&](awacorn::context& ctx) {
+                for (std::size_t i = 0; i < awaits; i++)
+                  sum += ctx >> awacorn::resolve<std::size_t>(1);
+              },
+              64 * 1024);
+        },
+        std::chrono::milliseconds(0));
+    ev.start();
+  });
+  if (sum != awaits) return 1;
+  // 3. 在回调中关闭队列：本次运行中已加入队列和之后产生的回调照常执行，
+  // start 返回后才生效。
+  std::size_t fired = 0;
+  bool deferred = false;
+  ev.event(
+      [&]() {
+        awacorn::promise<void> a, b;
+        a.then([&]() { fired++; });
+        a.resolve();
+        ev.set_microtask(false);
+        b.then([&]() { fired++; });
+        b.resolve();
+        deferred = fired == 0;
+      },
+      std::chrono::milliseconds(0));
+  ev.start();
+  if (!deferred || fired != 2) return 1;
+  // 关闭后回调同步执行；在回调中重新启用同样要等到下一次 start。
+  ev.event(
+      [&]() {
+        ev.set_microtask(true);
+        awacorn::promise<void> a;
+        a.then([&]() { fired++; });
+        a.resolve();
+        deferred = fired == 2;
+      },
+      std::chrono::milliseconds(0));
+  ev.start();
+  if (deferred || fired != 3) return 1;
+  ev.event(
+      [&]() {
+        awacorn::promise<void> a;
+        a.then([&]() { fired++; });
+        a.resolve();
+        deferred = fired == 3;
+      },
+      std::chrono::milliseconds(0));
+  ev.start();
+  if (!deferred || fired != 4) return 1;
+  std::cout << chain << " chained then (" << chain_tm << "us), " << awaits
+            << " awaits on settled promises (" << await_tm << "us)"
+            << std::endl;
+}
@@ -0,0 +1,62 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "event.hpp"
+#include "promise.hpp"
+constexpr std::size_t producers = 4;
+constexpr std::size_t posts = 100000;
+int main() {
+  awacorn::event_loop ev;
+  // 1. 循环因一个很远的定时事件而睡眠时，post 应立刻唤醒它。
+  auto far = ev.event([]() {}, std::chrono::seconds(10));
+  std::chrono::steady_clock::time_point sent;
+  std::chrono::steady_clock::duration latency;
+  std::thread waker([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sent = std::chrono::steady_clock::now();
+    ev.post([&]() {
+      latency = std::chrono::steady_clock::now() - sent;
+      ev.clear(far);
+    });
+  });
+  ev.start();
+  waker.join();
+  if (latency > std::chrono::seconds(1)) return 1;
+  // 2. 多个线程同时 post，并在循环线程上 resolve promise。
+  std::size_t count = 0;
+  awacorn::promise<std::size_t> done;
+  done.then([&](std::size_t n) { count = n; });
+  std::size_t received = 0;
+  std::vector<std::thread> pool;
+  ev.ref();
+  auto tm = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < producers; i++) {
+    pool.emplace_back([&]() {
+      for (std::size_t j = 0; j < posts; j++) {
+        ev.post([&]() {
+          if (++received == producers * posts) {
+            done.resolve(received);
+            ev.unref();
+          }
+        });
+      }
+    });
+  }
+  ev.start();
+  for (auto&& t : pool) t.join();
+  if (count != producers * posts) return 1;
+  std::cout << "wakeup latency "
+            << std::chrono::duration_cast<
+                   std::chrono::duration<long double, std::micro>>(latency)
+                   .count()
+            << "us, " << producers * posts << " posts from " << producers
+            << " threads ("
+            << std::chrono::duration_cast<
+                   std::chrono::duration<long double, std::micro>>(
+                   std::chrono::high_resolution_clock::now() - tm)
+                   .count()
+            << "us)" << std::endl;
+}
@@ -0,0 +1,42 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "promise.hpp"
+// 本程序以 AWACORN_SINGLE_THREAD 编译：默认的 promise 以普通读写维护引用
+// 计数，thread_safe 的 promise 使用原子操作。
+constexpr std::size_t copies = 10000000;
+constexpr std::size_t chains = 100000;
+template <typename Make>
+long double measure(const char* name, Make&& make) {
+  auto tm = std::chrono::high_resolution_clock::now();
+  // 1. 反复复制同一个 promise。
+  awacorn::promise<int> pm = make();
+  std::vector<awacorn::promise<int>> keep(16, pm);
+  for (std::size_t i = 0; i < copies; i++) {
+    awacorn::promise<int> copy = keep[i % keep.size()];
+    keep[(i + 1) % keep.size()] = std::move(copy);
+  }
+  // 2. 注册回调并完成，回调中同样持有 promise 的副本。
+  int sum = 0;
+  for (std::size_t i = 0; i < chains; i++) {
+    awacorn::promise<int> p = make();
+    p.then([p, &sum](int v) { sum += v; });
+    p.resolve(1);
+  }
+  long double us = std::chrono::duration_cast<
+                       std::chrono::duration<long double, std::micro>>(
+                       std::chrono::high_resolution_clock::now() - tm)
+                       .count();
+  std::cout << name << ": " << copies << " copies and " << chains
+            << " then chains in " << us << "us" << std::endl;
+  return sum == int(chains) ? us : -1;
+}
+int main() {
+  long double single =
+      measure("single-thread", []() { return awacorn::promise<int>(); });
+  long double safe = measure("thread-safe", []() {
+    return awacorn::promise<int>(awacorn::thread_safe);
+  });
+  if (single < 0 || safe < 0) return 1;
+}
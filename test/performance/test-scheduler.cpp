@@ -0,0 +1,99 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+
+#include "executor.hpp"
+constexpr std::size_t coroutines = 256;
+constexpr std::size_t steps = 8;
+// 纯计算，没有 I/O 和定时事件。
+std::uint64_t work(std::uint64_t seed) {
+  for (std::size_t i = 0; i < 20000; i++)
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return seed;
+}
+// 所有协程都从第 0 个工作线程创建，每一步计算之后让出线程。返回耗时，
+// migrated 为恢复时换了线程的次数。
+long double run(std::size_t n, std::uint64_t& sum, std::size_t& migrated) {
+  awacorn::executor ex(n);
+  std::atomic<std::size_t> moves(0);
+  std::size_t done = 0;
+  bool ok = true;
+  sum = 0;
+  auto tm = std::chrono::high_resolution_clock::now();
+  ex.loop(0).event(
+      [&]() {
+        for (std::size_t i = 0; i < coroutines; i++) {
+          ex.async([&ex, &moves, i](awacorn::context& ctx) {
+              std::uint64_t v = i;
+              // 不使用 std::this_thread::get_id()：pthread_self 被声明为
+              // const 函数，其结果可能在切换前后被合并。
+              awacorn::event_loop* ev = awacorn::executor::current();
+              for (std::size_t k = 0; k < steps; k++) {
+                v = work(v);
+                ctx >> ex.schedule();
+                if (awacorn::executor::current() != ev) moves++;
+                ev = awacorn::executor::current();
+              }
+              // 在恢复后所在线程的事件循环上等待定时事件。
+              awacorn::promise<void> pm;
+              awacorn::executor::current()->event(
+                  [pm]() { pm.resolve(); }, std::chrono::milliseconds(1));
+              ctx >> pm;
+              v += ctx >> ex.spawn([]() { return std::uint64_t(1); });
+              return v;
+            }).then([&](std::uint64_t v) {
+            // 结果交回第 0 个工作线程。
+            if (awacorn::executor::current() != &ex.loop(0)) ok = false;
+            sum += v;
+            if (++done == coroutines) ex.stop();
+          });
+        }
+      },
+      std::chrono::milliseconds(0));
+  ex.start();
+  if (!ok || done != coroutines) std::exit(1);
+  migrated = moves.load();
+  return std::chrono::duration_cast<
+             std::chrono::duration<long double, std::micro>>(
+             std::chrono::high_resolution_clock::now() - tm)
+      .count();
+}
+int main() {
+  std::size_t n = std::thread::hardware_concurrency();
+  if (n < 2) n = 2;
+  std::uint64_t single, multi;
+  std::size_t single_moves, multi_moves;
+  long double single_tm = run(1, single, single_moves);
+  long double multi_tm = run(n, multi, multi_moves);
+  if (single != multi || single_moves) return 1;
+  std::cout << coroutines << " coroutines x " << steps << " steps: 1 thread "
+            << single_tm << "us, " << n << " threads " << multi_tm << "us ("
+            << multi_moves << " resumptions on another thread)" << std::endl;
+  // 异常从协程交回调用线程；executor::async 只能在工作线程调用。
+  awacorn::executor ex(n);
+  bool ok = false;
+  ex.loop(0).event(
+      [&]() {
+        ex.async([&ex](awacorn::context& ctx) -> int {
+            ctx >> ex.schedule();
+            throw std::runtime_error("x");
+          }).error([&](std::exception_ptr&& err) {
+          try {
+            std::rethrow_exception(err);
+          } catch (const std::runtime_error&) {
+            ok = true;
+          }
+          ex.stop();
+        });
+      },
+      std::chrono::milliseconds(0));
+  ex.start();
+  try {
+    ex.async([](awacorn::context&) {});
+    return 1;
+  } catch (const std::logic_error&) {
+  }
+  return ok ? 0 : 1;
+}
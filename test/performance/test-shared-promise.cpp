@@ -0,0 +1,112 @@
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "alloc_count.hpp"
+#include "async.hpp"
+#include "promise.hpp"
+// 统计复制次数的结果类型。
+struct config {
+  static std::size_t copies;
+  std::vector<int> data;
+  config() : data(1024, 1) {}
+  config(const config& rhs) : data(rhs.data) { copies++; }
+  config(config&&) = default;
+  config& operator=(const config& rhs) {
+    data = rhs.data;
+    copies++;
+    return *this;
+  }
+  config& operator=(config&&) = default;
+};
+std::size_t config::copies = 0;
+constexpr std::size_t subscribers = 10000;
+long double elapsed(std::chrono::high_resolution_clock::time_point tm) {
+  return std::chrono::duration_cast<
+             std::chrono::duration<long double, std::micro>>(
+             std::chrono::high_resolution_clock::now() - tm)
+      .count();
+}
+int main() {
+  // 1. subscribers 个订阅者等待同一个结果，与每个订阅者一个 promise
+  // (复制结果) 的扇出比较。
+  std::size_t sum = 0;
+  alloc_count::reset();
+  auto tm = std::chrono::high_resolution_clock::now();
+  {
+    awacorn::promise<config> source;
+    awacorn::shared_promise<config> shared(source);
+    for (std::size_t i = 0; i < subscribers; i++)
+      shared.subscribe([&sum](const config& v) { sum += v.data[0]; },
+                       [](std::exception_ptr&&) {});
+    source.resolve(config());
+  }
+  long double shared_tm = elapsed(tm);
+  double shared_alloc = double(alloc_count::allocations()) / subscribers;
+  std::size_t shared_copies = config::copies;
+  std::size_t fanout_sum = 0;
+  alloc_count::reset();
+  tm = std::chrono::high_resolution_clock::now();
+  {
+    awacorn::promise<config> source;
+    std::vector<awacorn::promise<config>> waiters(subscribers);
+    for (auto&& w : waiters)
+      w.then([&fanout_sum](config&& v) { fanout_sum += v.data[0]; });
+    source.then([&waiters](config&& v) {
+      for (auto&& w : waiters) w.resolve(v);
+    });
+    source.resolve(config());
+  }
+  long double fanout_tm = elapsed(tm);
+  double fanout_alloc = double(alloc_count::allocations()) / subscribers;
+  std::size_t fanout_copies = config::copies - shared_copies;
+  std::cout << subscribers << " subscribers: shared_promise " << shared_tm
+            << "us (" << shared_alloc << " allocations, " << shared_copies
+            << " copies), fan-out " << fanout_tm << "us (" << fanout_alloc
+            << " allocations, " << fanout_copies << " copies)" << std::endl;
+  if (sum != subscribers || fanout_sum != subscribers || shared_copies ||
+      shared_alloc >= fanout_alloc)
+    return 1;
+  // 2. 多个协程 await 同一个 shared_promise，取得同一个对象的引用。
+  awacorn::shared_promise<config> shared;
+  std::vector<const config*> seen;
+  for (int i = 0; i < 4; i++)
+    awacorn::async([&shared, &seen](awacorn::context& ctx) {
+      const config& v = ctx >> shared;
+      seen.push_back(&v);
+    });
+  shared.resolve(config());
+  // 完成之后订阅同样可以取得结果。
+  awacorn::async([&shared, &seen](awacorn::context& ctx) {
+    seen.push_back(&(ctx >> shared));
+  });
+  if (seen.size() != 5 || config::copies != shared_copies + fanout_copies)
+    return 1;
+  for (auto&& p : seen)
+    if (p != &shared.value()) return 1;
+  // 3. 失败传递给所有订阅者，value() 重新抛出错误；不会因为没有订阅者而中止。
+  awacorn::promise<void> failing;
+  awacorn::shared_promise<void> shared_void(failing);
+  std::size_t caught = 0;
+  for (int i = 0; i < 3; i++)
+    shared_void.then([]() {}).error([&caught](std::exception_ptr&&) {
+      caught++;
+    });
+  awacorn::async([&](awacorn::context& ctx) {
+    try {
+      ctx >> shared_void;
+    } catch (const std::runtime_error&) {
+      caught++;
+    }
+  });
+  failing.reject(std::make_exception_ptr(std::runtime_error("x")));
+  try {
+    shared_void.value();
+    return 1;
+  } catch (const std::runtime_error&) {
+  }
+  awacorn::shared_promise<int>().reject(
+      std::make_exception_ptr(std::runtime_error("x")));
+  return caught == 4 ? 0 : 1;
+}
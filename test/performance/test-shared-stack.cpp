@@ -0,0 +1,112 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "async.hpp"
+#include "promise.hpp"
+#include <unistd.h>
+constexpr std::size_t coroutines = 10000;
+// 在栈上占用 512 字节，并在恢复后检查数据是否完好。
+std::size_t idle(awacorn::context& ctx, const awacorn::promise<void>& pm,
+                 std::size_t i) {
+  volatile unsigned char buf[512];
+  for (auto&& c : buf) c = static_cast<unsigned char>(i);
+  ctx >> pm;
+  for (auto&& c : buf)
+    if (c != static_cast<unsigned char>(i)) return 0;
+  return 1;
+}
+// 析构时检查栈上的标记是否完好，完好则计数。
+struct guard {
+  std::size_t* count;
+  volatile int tag;
+  ~guard() {
+    if (tag == 42) ++*count;
+  }
+};
+// 当前进程的常驻内存 (字节)。
+std::size_t rss() {
+  std::size_t size = 0, resident = 0;
+  std::ifstream("/proc/self/statm") >> size >> resident;
+  return resident * std::size_t(sysconf(_SC_PAGESIZE));
+}
+// 同时挂起 coroutines 个协程再逐个恢复，返回每个协程占用的常驻内存。
+std::size_t measure(bool shared) {
+  std::vector<awacorn::promise<void>> pms(coroutines);
+  std::vector<awacorn::promise<std::size_t>> tasks;
+  tasks.reserve(coroutines);
+  std::size_t before = rss();
+  for (std::size_t i = 0; i < coroutines; i++) {
+    awacorn::promise<void> pm = pms[i];
+    auto fn = [pm, i](awacorn::context& ctx) { return idle(ctx, pm, i); };
+    tasks.push_back(shared ? awacorn::async(fn, awacorn::shared_stack)
+                           : awacorn::async(fn));
+  }
+  std::size_t used = (rss() - before) / coroutines;
+  std::size_t ok = 0;
+  for (auto&& task : tasks) task.then([&ok](std::size_t v) { ok += v; });
+  for (auto&& pm : pms) pm.resolve();
+  return ok == coroutines ? used : std::size_t(-1);
+}
+int main() {
+  awacorn::stack_pool& pool = *awacorn::stack_pool::local();
+  // 所有协程都在同一个共享栈上，互相切换时一定需要复制。
+  if (!pool.set_shared(1, 256 * 1024)) return 1;
+  // 1. 在共享栈上的协程中恢复同一个栈上的另一个协程。
+  awacorn::promise<int> pm;
+  int result = 0;
+  awacorn::async(
+      [&](awacorn::context& ctx) {
+        volatile char local[256];
+        std::memset((char*)local, 5, sizeof(local));
+        int v = ctx >> pm;
+        for (auto&& c : local)
+          if (c != 5) return;
+        result += v;
+      },
+      awacorn::shared_stack);
+  awacorn::async(
+      [&](awacorn::context&) {
+        volatile char local[256];
+        std::memset((char*)local, 7, sizeof(local));
+        pm.resolve(1);
+        for (auto&& c : local)
+          if (c != 7) return;
+        result += 1;
+      },
+      awacorn::shared_stack);
+  if (result != 2) return 1;
+  // 2. 析构挂起在共享栈上、栈内容已被另一个协程换出的协程，需要先换回栈内容
+  // 再展开，栈上对象的析构函数才能执行。
+  std::size_t destroyed = 0;
+  {
+    awacorn::promise<void> b, a;
+    awacorn::async(
+        [&](awacorn::context& ctx) {
+          guard g{&destroyed, 42};
+          ctx >> a;
+        },
+        awacorn::shared_stack);
+    // 占用共享栈，换出上一个协程的栈内容。
+    awacorn::async(
+        [&](awacorn::context& ctx) {
+          guard g{&destroyed, 42};
+          volatile char local[256];
+          std::memset((char*)local, 9, sizeof(local));
+          ctx >> b;
+        },
+        awacorn::shared_stack);
+    // a 先于 b 析构：先展开栈内容被换出的协程，再展开占用共享栈的协程。
+  }
+  if (destroyed != 2) return 1;
+  // 3. 大量空闲的协程。
+  std::size_t shared = measure(true), isolated = measure(false);
+  if (shared == std::size_t(-1) || isolated == std::size_t(-1)) return 1;
+  std::cout << coroutines << " idle coroutines: " << shared
+            << " bytes resident each on shared stacks, " << isolated
+            << " bytes each on their own stacks" << std::endl;
+#if defined(AWACORN_USE_ASM)
+  if (shared >= isolated) return 1;
+#endif
+}
@@ -0,0 +1,54 @@
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "async.hpp"
+#include "promise.hpp"
+#if defined(AWACORN_USE_MMAP_STACK)
+#include <sys/wait.h>
+#include <unistd.h>
+constexpr std::size_t coroutines = 10000;
+constexpr std::size_t stack_size = 256 * 1024;
+// 当前进程的常驻内存 (字节)。
+std::size_t rss() {
+  std::size_t size = 0, resident = 0;
+  std::ifstream("/proc/self/statm") >> size >> resident;
+  return resident * std::size_t(sysconf(_SC_PAGESIZE));
+}
+#endif
+int main() {
+#if defined(AWACORN_USE_MMAP_STACK)
+  // 1. 同时挂起大量协程。栈只按实际访问的页占用内存。
+  std::vector<awacorn::promise<void>> pms(coroutines), tasks;
+  tasks.reserve(coroutines);
+  std::size_t before = rss();
+  for (std::size_t i = 0; i < coroutines; i++) {
+    awacorn::promise<void> pm = pms[i];
+    tasks.push_back(awacorn::async(
+        [pm](awacorn::context& ctx) { ctx >> pm; }, stack_size));
+  }
+  std::size_t per_coroutine = (rss() - before) / coroutines;
+  std::size_t finished = 0;
+  for (auto&& task : tasks) task.then([&finished]() { finished++; });
+  for (auto&& pm : pms) pm.resolve();
+  if (finished != coroutines) return 1;
+  std::cout << coroutines << " suspended coroutines with "
+            << stack_size / 1024 << " KiB stacks: " << per_coroutine
+            << " bytes resident each" << std::endl;
+  if (per_coroutine >= stack_size / 8) return 1;
+  // 2. 栈底之下是保护页，越界写入会触发 SIGSEGV。
+  awacorn::stack_pool& pool = *awacorn::stack_pool::local();
+  char* stack = static_cast<char*>(pool.allocate(stack_size));
+  pid_t child = fork();
+  if (child == 0) {
+    *(volatile char*)(stack - 1) = 0;
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+  pool.deallocate(stack, stack_size);
+  if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV) return 1;
+#else
+  std::cout << "mmap stacks are unavailable, skipped" << std::endl;
+#endif
+}
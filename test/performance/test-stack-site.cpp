@@ -0,0 +1,79 @@
+#include <fstream>
+#include <iostream>
+
+#include "async.hpp"
+#include "promise.hpp"
+#include <unistd.h>
+constexpr std::size_t depth = 24 * 1024;
+// 在栈上占用约 depth 字节。
+__attribute__((noinline)) std::size_t deep(std::size_t seed) {
+  volatile unsigned char buf[depth];
+  for (std::size_t i = 0; i < depth; i += 512) buf[i] = (unsigned char)seed;
+  return buf[0] + 1;
+}
+// 当前进程的常驻内存 (字节)。
+std::size_t rss() {
+  std::size_t size = 0, resident = 0;
+  std::ifstream("/proc/self/statm") >> size >> resident;
+  return resident * std::size_t(sysconf(_SC_PAGESIZE));
+}
+int main() {
+  // 1. 只统计不调整。
+  awacorn::stack_site site("deep");
+  for (std::size_t i = 0; i < 4; i++)
+    awacorn::async([](awacorn::context&) { deep(1); }, site);
+  if (site.samples() != 4 || site.peak() < depth || site.peak() > depth * 2 ||
+      site.size() != 1024 * 1024)
+    return 1;
+  // 2. 自适应：预热之后栈大小收敛到峰值加余量。
+  awacorn::stack_site adaptive("adaptive", 1024 * 1024, true);
+  std::size_t sum = 0;
+  for (std::size_t i = 0; i < awacorn::stack_site::warmup * 2; i++) {
+    awacorn::async([](awacorn::context&) { return deep(1); }, adaptive)
+        .then([&sum](std::size_t v) { sum += v; });
+  }
+  std::cout << "peak " << adaptive.peak() << " bytes, average "
+            << adaptive.average() << " bytes, adaptive stack size "
+            << adaptive.size() << " bytes" << std::endl;
+  if (sum != awacorn::stack_site::warmup * 4 ||
+      adaptive.size() < adaptive.peak() * 2 || adaptive.size() > 128 * 1024)
+    return 1;
+  // 3. 抛出异常的协程同样会被统计。
+  awacorn::stack_site thrown("thrown");
+  bool rejected = false;
+  awacorn::async(
+      [](awacorn::context&) -> int { throw deep(1); }, thrown)
+      .error([&rejected](std::exception_ptr&&) { rejected = true; });
+  if (!rejected || thrown.samples() != 1 || thrown.peak() < depth) return 1;
+  // 4. 预热之后每 interval 个协程抽样一个，并逐个报告被抽样的协程的用量。
+  static std::size_t reported = 0;
+  awacorn::stack_site sampled("sampled");
+  sampled.set_sample_interval(4);
+  sampled.set_report([](const awacorn::stack_site& site, std::size_t usage) {
+    if (usage >= depth && site.name()) reported++;
+  });
+  for (std::size_t i = 0; i < awacorn::stack_site::warmup + 16; i++)
+    awacorn::async([](awacorn::context&) { deep(1); }, sampled);
+  if (sampled.samples() != awacorn::stack_site::warmup + 4 ||
+      reported != sampled.samples())
+    return 1;
+  // 5. 峰值接近初始大小时，自适应的栈大小可以超过初始大小。
+  awacorn::stack_site grow("grow", depth, true);
+  for (std::size_t i = 0; i < awacorn::stack_site::warmup; i++)
+    awacorn::async([](awacorn::context&) { deep(1); }, grow);
+  if (grow.size() <= awacorn::detail::stack_pool::round(depth)) return 1;
+  grow.set_max_size(depth);
+  if (grow.size() != awacorn::detail::stack_pool::round(depth)) return 1;
+  // 6. 填充过的栈归还时交还物理页，留在栈池中的栈不占用内存。
+  awacorn::stack_site large("large", 8 * 1024 * 1024);
+  std::size_t before = rss();
+  for (std::size_t i = 0; i < awacorn::stack_site::warmup; i++)
+    awacorn::async([](awacorn::context&) { deep(1); }, large);
+  std::size_t after = rss();
+  std::cout << "rss after " << awacorn::stack_site::warmup
+            << " painted 8 MiB stacks: +" << (after - before) / 1024 << " KiB"
+            << std::endl;
+#if defined(AWACORN_USE_MMAP_STACK)
+  if (after > before + 1024 * 1024) return 1;
+#endif
+}
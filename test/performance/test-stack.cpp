@@ -0,0 +1,37 @@
+#include <chrono>
+#include <iostream>
+
+#include "async.hpp"
+#include "promise.hpp"
+constexpr std::size_t coroutines = 10000;
+constexpr std::size_t stack_size = 256 * 1024;
+// 依次创建并销毁协程，每个协程都会 await 一个已完成的 promise。
+long double run() {
+  std::size_t sum = 0;
+  auto tm = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < coroutines; i++) {
+    awacorn::async(
+        [&](awacorn::context& ctx) { sum += ctx >> awacorn::resolve(1); },
+        stack_size);
+  }
+  if (sum != coroutines) return -1;
+  return std::chrono::duration_cast<
+             std::chrono::duration<long double, std::micro>>(
+             std::chrono::high_resolution_clock::now() - tm)
+      .count();
+}
+int main() {
+  awacorn::stack_pool& pool = *awacorn::stack_pool::local();
+  pool.set_limit(0);
+  long double uncached = run();
+  if (pool.cached()) return 1;
+  pool.set_limit(64);
+  long double cached = run();
+  // 协程依次销毁，同一时间只需要一个栈。
+  if (pool.cached() != awacorn::stack_pool::round(stack_size)) return 1;
+  pool.trim();
+  if (pool.cached()) return 1;
+  std::cout << coroutines << " coroutines with " << stack_size / 1024
+            << " KiB stacks: " << uncached << "us without pool, " << cached
+            << "us with pool" << std::endl;
+}
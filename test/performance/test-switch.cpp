@@ -0,0 +1,42 @@
+#include <chrono>
+#include <iostream>
+
+#include "detail/context.hpp"
+#if defined(AWACORN_USE_BOOST)
+constexpr const char* backend = "boost";
+#elif defined(AWACORN_USE_UCONTEXT)
+constexpr const char* backend = "ucontext";
+#elif defined(AWACORN_USE_ASM)
+constexpr const char* backend = "asm";
+#endif
+constexpr std::size_t rounds = 1000000;
+struct state {
+  awacorn::detail::basic_context* ctx;
+  std::size_t count;
+};
+// 每轮切回调用方一次。
+void run(void* arg) {
+  state* s = static_cast<state*>(arg);
+  for (std::size_t i = 0; i < rounds; i++) {
+    s->count++;
+    s->ctx->resume();
+  }
+}
+int main() {
+  state s = {nullptr, 0};
+  awacorn::detail::basic_context ctx(run, &s);
+  s.ctx = &ctx;
+  auto tm = std::chrono::high_resolution_clock::now();
+  // 每次 resume 切入协程再切回，共两次切换；最后一次 resume 使协程结束。
+  for (std::size_t i = 0; i <= rounds; i++) {
+    ctx.resume();
+    if (s.count != (i < rounds ? i + 1 : rounds)) return 1;
+  }
+  long double us = std::chrono::duration_cast<
+                       std::chrono::duration<long double, std::micro>>(
+                       std::chrono::high_resolution_clock::now() - tm)
+                       .count();
+  std::cout << backend << ": " << rounds * 2 << " switches in " << us
+            << "us (" << rounds * 2 / us * 1000000 << " switches/s)"
+            << std::endl;
+}
@@ -0,0 +1,105 @@
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "async.hpp"
+#include "promise.hpp"
+constexpr std::size_t children = 10000;
+constexpr std::size_t limit = 16;
+// 统计同时存活的子协程 (帧中的对象)。
+std::size_t live = 0, peak = 0;
+struct guard {
+  guard() { peak = std::max(peak, ++live); }
+  ~guard() { live--; }
+};
+int main() {
+  // 1. 限制同时运行的数量，子协程结束后帧立即释放。
+  std::vector<awacorn::promise<std::size_t>> pms(children);
+  std::size_t sum = 0;
+  bool finished = false;
+  awacorn::async([&](awacorn::context& ctx) {
+    awacorn::task_group group(limit);
+    for (std::size_t i = 0; i < children; i++) {
+      group.spawn([&, i](awacorn::context& ctx) {
+        guard g;
+        sum += ctx >> pms[i];
+      });
+    }
+    if (group.running() != limit || group.queued() != children - limit)
+      return;
+    ctx >> group.wait();
+    finished = true;
+  });
+  for (std::size_t i = 0; i < children; i++) pms[i].resolve(i);
+  std::cout << children << " children with limit " << limit << ": " << peak
+            << " alive at most" << std::endl;
+  if (!finished || sum != children * (children - 1) / 2 || peak != limit ||
+      live)
+    return 1;
+  // 2. 第一个失败的子协程取消其余的子协程，wait 以它的异常失败。
+  std::vector<awacorn::promise<void>> waits(4);
+  std::size_t cancelled = 0, started = 0;
+  bool failed = false;
+  awacorn::promise<void> trigger;
+  awacorn::async([&](awacorn::context& ctx) {
+    awacorn::task_group group(waits.size() + 1);
+    for (std::size_t i = 0; i < waits.size(); i++) {
+      group.spawn([&, i](awacorn::context& ctx) {
+        started++;
+        try {
+          ctx >> waits[i];
+        } catch (const awacorn::task_cancelled&) {
+          cancelled++;
+          throw;
+        }
+      });
+    }
+    group.spawn([&](awacorn::context& ctx) -> int {
+      started++;
+      ctx >> trigger;
+      throw std::runtime_error("x");
+    });
+    // 达到上限，等待开始；任务组失败后被丢弃。
+    group.spawn([&](awacorn::context&) { started++; });
+    try {
+      ctx >> group.wait();
+    } catch (const std::runtime_error&) {
+      failed = true;
+    }
+  });
+  trigger.resolve();
+  if (!failed || cancelled != waits.size() || started != waits.size() + 1)
+    return 1;
+  // 被取消的 await 原本的 promise 之后完成也不会再次恢复协程。
+  for (auto&& pm : waits) pm.resolve();
+  // 3. 析构任务组时取消仍在运行的子协程；被取消的协程不会再次 await。
+  awacorn::promise<void> never;
+  bool unwound = false;
+  {
+    awacorn::task_group group;
+    group.spawn([&](awacorn::context& ctx) {
+      try {
+        ctx >> never;
+      } catch (const awacorn::task_cancelled&) {
+        unwound = true;
+      }
+    });
+  }
+  if (!unwound) return 1;
+  never.resolve();
+  // 4. 取消后子协程的帧立即释放，不会被它曾 await 的、尚未完成的 promise
+  // 留住。
+  awacorn::promise<void> pending;
+  std::shared_ptr<int> probe = std::make_shared<int>(0);
+  std::weak_ptr<int> frame = probe;
+  {
+    awacorn::task_group group;
+    group.spawn([&pending, probe](awacorn::context& ctx) { ctx >> pending; });
+    probe.reset();
+    if (frame.expired()) return 1;
+    group.cancel();
+    if (!frame.expired()) return 1;
+  }
+  pending.resolve();
+}
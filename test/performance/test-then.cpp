@@ -0,0 +1,53 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "alloc_count.hpp"
+#include "promise.hpp"
+constexpr std::size_t calls = 100000;
+using pm_t = awacorn::promise<std::size_t>;
+int main() {
+  {
+    pm_t pm;
+    std::cout << "promise<std::size_t> state: " << alloc_count::last_size()
+              << " bytes" << std::endl;
+  }
+  // 在 calls 个 promise 上各注册一次回调并完成它，统计平均每个 promise
+  // 调用 operator new 的次数 (包括 then 返回的 promise)。
+  std::size_t sum = 0;
+  // 1. then：结果 promise 与一条回调记录。
+  double then = alloc_count::resolve_each("then", calls, sum, [&](pm_t& pm) {
+    pm.then([&sum](std::size_t v) { sum += v; });
+  });
+  // 2. 较大的闭包同样与回调记录位于同一次分配中。
+  std::size_t a = 0, b = 0, c = 0;
+  double large = alloc_count::resolve_each("large", calls, sum, [&](pm_t& pm) {
+    pm.then([&sum, &a, &b, &c](std::size_t v) { sum += v + a + b + c; });
+  });
+  // 3. then 与 finally 注册在同一个 promise 上。
+  std::size_t settled = 0;
+  double all =
+      alloc_count::resolve_each("then+finally", calls, sum, [&](pm_t& pm) {
+        pm.then([&sum](std::size_t v) { sum += v; });
+        pm.finally([&settled]() { settled++; });
+      });
+  if (then < 0 || large < 0 || all < 0 || settled != calls) return 1;
+  // 回调的调用顺序：先 then / error，后 finally；错误沿 then 链传递。
+  std::vector<int> order;
+  awacorn::promise<int> p;
+  p.finally([&order]() { order.push_back(2); });
+  p.then([&order](int) { order.push_back(1); })
+      .error([&order](std::exception_ptr&&) { order.push_back(4); });
+  p.reject(std::make_exception_ptr(std::runtime_error("x")));
+  if (order != std::vector<int>({4, 2})) return 1;
+  // 同一结果只能被取走一次。
+  awacorn::promise<int> q;
+  q.then([](int) {});
+  try {
+    q.then([](int) {});
+    return 1;
+  } catch (const std::logic_error&) {
+  }
+  q.resolve(0);
+  return 0;
+}
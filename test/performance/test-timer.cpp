@@ -0,0 +1,108 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include "detail/timer.hpp"
+using clock_type = std::chrono::steady_clock;
+// 固定的伪随机数，保证每个后端的负载一致。
+struct lcg {
+  std::uint64_t state;
+  std::uint64_t operator()() {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state >> 33;
+  }
+};
+constexpr std::size_t horizon_ms = 100;
+template <typename Fn>
+long double measure(Fn&& fn) {
+  auto tm = std::chrono::high_resolution_clock::now();
+  fn();
+  return std::chrono::duration_cast<
+             std::chrono::duration<long double, std::micro>>(
+             std::chrono::high_resolution_clock::now() - tm)
+      .count();
+}
+// 旧版 event_loop 的实现：以相对时间存放于 std::list，每轮扫描全部事件。
+std::size_t run_list(std::size_t n) {
+  struct event {
+    clock_type::duration timeout;
+  };
+  std::list<event> list;
+  auto advance = [&list](clock_type::duration duration) {
+    for (auto it = list.begin(); it != list.end(); it++) {
+      it->timeout = it->timeout > duration ? (it->timeout - duration)
+                                           : clock_type::duration(0);
+    }
+  };
+  std::vector<std::list<event>::iterator> handle;
+  handle.reserve(n);
+  lcg rng{n};
+  for (std::size_t i = 0; i < n; i++) {
+    list.push_back(event{std::chrono::milliseconds(1 + rng() % horizon_ms)});
+    handle.push_back(--list.end());
+  }
+  for (std::size_t i = 0; i < n; i++) {
+    if (i % 10) list.erase(handle[i]);
+  }
+  std::size_t fired = 0;
+  while (!list.empty()) {
+    auto min = list.cbegin();
+    for (auto it = list.cbegin(); it != list.cend(); it++) {
+      if (it->timeout < min->timeout) min = it;
+    }
+    // 模拟 yield 恰好睡眠到最早的事件。
+    advance(min->timeout);
+    for (auto it = list.begin(); it != list.end();) {
+      if (it->timeout == clock_type::duration(0)) {
+        fired++;
+        it = list.erase(it);
+        continue;
+      }
+      it++;
+    }
+    // 模拟回调本身不耗时。
+    advance(clock_type::duration(0));
+  }
+  return fired;
+}
+std::size_t run_queue(awacorn::detail::timer_queue& queue,
+                      const clock_type::time_point& origin, std::size_t n) {
+  std::vector<awacorn::detail::timer_node> node(n);
+  lcg rng{n};
+  for (std::size_t i = 0; i < n; i++) {
+    node[i].deadline =
+        origin + std::chrono::milliseconds(1 + rng() % horizon_ms);
+    node[i].seq = i;
+    queue.push(&node[i]);
+  }
+  for (std::size_t i = 0; i < n; i++) {
+    if (i % 10) queue.erase(&node[i]);
+  }
+  std::size_t fired = 0;
+  auto now = origin;
+  while (!queue.empty()) {
+    auto next = queue.next();
+    if (next > now) now = next;
+    while (queue.pop(now, n)) fired++;
+  }
+  return fired;
+}
+int main() {
+  for (std::size_t n = 1000; n <= 1000000; n *= 10) {
+    std::size_t fired[3];
+    auto origin = clock_type::now();
+    awacorn::detail::timer_heap heap;
+    awacorn::detail::timer_wheel wheel(std::chrono::milliseconds(1), origin);
+    long double list_tm = measure([&]() { fired[0] = run_list(n); });
+    long double heap_tm =
+        measure([&]() { fired[1] = run_queue(heap, origin, n); });
+    long double wheel_tm =
+        measure([&]() { fired[2] = run_queue(wheel, origin, n); });
+    if (fired[0] != fired[1] || fired[1] != fired[2]) return 1;
+    std::cout << n << " timers (90% cancelled): list " << list_tm
+              << "us, heap " << heap_tm << "us, wheel " << wheel_tm << "us"
+              << std::endl;
+  }
+}